@@ -0,0 +1,564 @@
+// g++ -std=c++17 -O2 -march=native -pthread benchmarks.cpp -o benchmarks
+// ./benchmarks [max_n = 1000000] [filter] [seed]
+// размеры 1e3, 1e4, ... до max_n; каждый замер идёт в отдельном процессе, чтобы пиковый RSS
+// относился только к нему
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cartesian_tree.h"
+#include "dyn_matrix.h"
+#include "matrix.h"
+#include "segment_tree.h"
+#include "sparse_segment_tree.h"
+#include "wide_segment_tree.h"
+#include "rmq_rsq.cpp"
+
+// воспроизводимая нагрузка: всё определяется seed и n
+class Workload {
+ private:
+  std::mt19937_64 gen_;
+
+ public:
+  explicit Workload(uint64_t seed) : gen_(seed) {
+  }
+
+  int64_t Uniform(int64_t from, int64_t to) {  // включая to
+    return std::uniform_int_distribution<int64_t>(from, to)(gen_);
+  }
+
+  std::vector<int> Values(size_t n, int from, int to) {
+    std::vector<int> v(n);
+    for (auto& x : v) {
+      x = static_cast<int>(Uniform(from, to));
+    }
+    return v;
+  }
+
+  std::pair<size_t, size_t> Range(size_t n) {
+    size_t l = Uniform(0, n - 1);
+    size_t r = Uniform(0, n - 1);
+    return std::minmax(l, r);
+  }
+};
+
+struct Measurement {
+  size_t ops = 0;
+  double seconds = 0;
+  int64_t checksum = 0;  // чтобы компилятор не выбросил запросы
+};
+
+template <class F>
+Measurement Measure(size_t ops, F&& f) {
+  Measurement res;
+  res.ops = ops;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < ops; ++i) {
+    res.checksum += f(i);
+  }
+  res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return res;
+}
+
+// у наивных проходов число операций ограничено, чтобы один замер шёл секунды, а не часы
+size_t NaiveOps(size_t n) {
+  return std::max<size_t>(16, (size_t{1} << 28) / n);
+}
+
+const size_t kOps = 1 << 20;
+
+using Benchmark = std::function<Measurement(size_t n, Workload& w)>;
+
+Measurement CartesianInsert(size_t n, Workload& w) {
+  CartesianTree<> tree;
+  return Measure(n, [&](size_t) {
+    tree.Insert(static_cast<int>(w.Uniform(0, std::numeric_limits<int>::max())), static_cast<int>(w.Uniform(0, 1 << 30)));
+    return 0;
+  });
+}
+
+Measurement SetInsert(size_t n, Workload& w) {
+  std::set<int> set;
+  return Measure(n, [&](size_t) {
+    set.insert(static_cast<int>(w.Uniform(0, std::numeric_limits<int>::max())));
+    return 0;
+  });
+}
+
+Measurement CartesianErase(size_t n, Workload& w) {
+  CartesianTree<> tree;
+  auto keys = w.Values(n, 0, std::numeric_limits<int>::max());
+  for (auto k : keys) {
+    tree.Insert(k, static_cast<int>(w.Uniform(0, 1 << 30)));
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+  return Measure(n, [&](size_t i) {
+    tree.Erase(keys[i]);
+    return 0;
+  });
+}
+
+Measurement SetErase(size_t n, Workload& w) {
+  std::set<int> set;
+  auto keys = w.Values(n, 0, std::numeric_limits<int>::max());
+  set.insert(keys.begin(), keys.end());
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+  return Measure(n, [&](size_t i) {
+    set.erase(keys[i]);
+    return 0;
+  });
+}
+
+Measurement CartesianKth(size_t n, Workload& w) {
+  CartesianTree<> tree;
+  for (size_t i = 0; i < n; ++i) {
+    tree.Insert(static_cast<int>(i), static_cast<int>(w.Uniform(0, 1 << 30)));
+  }
+  return Measure(kOps, [&](size_t) { return *tree.KthElement(static_cast<int>(w.Uniform(0, n - 1))); });
+}
+
+Measurement SetKth(size_t n, Workload& w) {  // у std::set нет порядковой статистики — проход итератором
+  std::set<int> set;
+  for (size_t i = 0; i < n; ++i) {
+    set.insert(static_cast<int>(i));
+  }
+  return Measure(NaiveOps(n), [&](size_t) { return *std::next(set.begin(), w.Uniform(0, n - 1)); });
+}
+
+Measurement CartesianSumAdd(size_t n, Workload& w) {
+  CartesianTree<> tree;
+  for (size_t i = 0; i < n; ++i) {
+    tree.Insert(static_cast<int>(i), static_cast<int>(w.Uniform(0, 1 << 30)));
+  }
+  return Measure(kOps, [&](size_t i) -> int64_t {
+    auto[l, r] = w.Range(n);
+    if (i % 2 == 0) {
+      tree.Add(static_cast<int>(l), static_cast<int>(r) + 1, 1);
+      return 0;
+    }
+    return tree.Sum(static_cast<int>(l), static_cast<int>(r) + 1);
+  });
+}
+
+Measurement NaiveSumAdd(size_t n, Workload& w) {
+  std::vector<int64_t> v(n);
+  return Measure(NaiveOps(n), [&](size_t i) -> int64_t {
+    auto[l, r] = w.Range(n);
+    int64_t sum = 0;
+    for (size_t j = l; j <= r; ++j) {
+      if (i % 2 == 0) {
+        ++v[j];
+      } else {
+        sum += v[j];
+      }
+    }
+    return sum;
+  });
+}
+
+Measurement SegmentMaxAdd(size_t n, Workload& w) {
+  SegmentTree<> tree(w.Values(n, -1000000, 1000000));
+  return Measure(kOps, [&](size_t i) -> int64_t {
+    auto[l, r] = w.Range(n);
+    if (i % 2 == 0) {
+      tree.Update(l, r, static_cast<int>(w.Uniform(-10, 10)));
+      return 0;
+    }
+    return tree.Query(l, r);
+  });
+}
+
+Measurement SegmentBatchMaxAdd(size_t n, Workload& w) {  // одно обновление на 64 запроса, все потоки
+  SegmentTree<> tree(w.Values(n, -1000000, 1000000));
+  std::vector<SegmentTree<>::Operation> ops(kOps);
+  for (size_t i = 0; i < kOps; ++i) {
+    auto[l, r] = w.Range(n);
+    ops[i] = {l, r, i % 64 == 0, static_cast<int>(w.Uniform(-10, 10))};
+  }
+  ThreadPool pool;
+  auto res = Measure(1, [&](size_t) {
+    auto answers = tree.Batch(ops, &pool);
+    int64_t sum = 0;
+    for (size_t i = 0; i < kOps; ++i) {
+      sum += ops[i].is_update ? 0 : answers[i];
+    }
+    return sum;
+  });
+  res.ops = kOps;
+  return res;
+}
+
+Measurement WideSegmentMaxAdd(size_t n, Workload& w) {
+  WideSegmentTree<> tree(w.Values(n, -1000000, 1000000));
+  return Measure(kOps, [&](size_t i) -> int64_t {
+    auto[l, r] = w.Range(n);
+    if (i % 2 == 0) {
+      tree.Update(l, r, static_cast<int>(w.Uniform(-10, 10)));
+      return 0;
+    }
+    return tree.Query(l, r);
+  });
+}
+
+Measurement SparseSegmentMaxAdd(size_t n, Workload& w) {  // нетронутые позиции равны 0
+  SparseSegmentTree<> tree(n);
+  return Measure(kOps, [&](size_t i) -> int64_t {
+    auto[l, r] = w.Range(n);
+    if (i % 2 == 0) {
+      tree.Update(l, r, w.Uniform(-10, 10));
+      return 0;
+    }
+    return tree.Query(l, r);
+  });
+}
+
+Measurement NaiveMaxAdd(size_t n, Workload& w) {
+  auto v = w.Values(n, -1000000, 1000000);
+  return Measure(NaiveOps(n), [&](size_t i) -> int64_t {
+    auto[l, r] = w.Range(n);
+    if (i % 2 == 0) {
+      int delta = static_cast<int>(w.Uniform(-10, 10));
+      for (size_t j = l; j <= r; ++j) {
+        v[j] += delta;
+      }
+      return 0;
+    }
+    return *std::max_element(v.begin() + l, v.begin() + r + 1);
+  });
+}
+
+template <class Fenwick>
+Measurement FenwickAddQuery(size_t n, Workload& w) {
+  Fenwick tree(w.Values(n, -1000, 1000));
+  return Measure(kOps, [&](size_t i) -> int64_t {
+    if (i % 2 == 0) {
+      tree.Add(w.Uniform(0, n - 1), w.Uniform(-1000, 1000));
+      return 0;
+    }
+    auto[l, r] = w.Range(n);
+    return tree.Query(static_cast<int>(l), static_cast<int>(r));
+  });
+}
+
+Measurement FenwickLowerBound(size_t n, Workload& w) {  // выбор позиции с вероятностью, пропорциональной весу
+  FenwickTree tree(w.Values(n, 0, 1000));
+  int64_t total = tree.Query(0, static_cast<int>(n) - 1);
+  return Measure(kOps, [&](size_t) { return static_cast<int64_t>(tree.LowerBound(w.Uniform(1, total))); });
+}
+
+Measurement RangeFenwickSumAdd(size_t n, Workload& w) {
+  std::vector<int> zeros(n);
+  RangeFenwickTree tree(zeros);
+  return Measure(kOps, [&](size_t i) -> int64_t {
+    auto[l, r] = w.Range(n);
+    if (i % 2 == 0) {
+      tree.Add(l, r, 1);
+      return 0;
+    }
+    return tree.Query(l, r);
+  });
+}
+
+Measurement NaiveAddQuery(size_t n, Workload& w) {
+  auto v = w.Values(n, -1000, 1000);
+  return Measure(NaiveOps(n), [&](size_t i) -> int64_t {
+    if (i % 2 == 0) {
+      v[w.Uniform(0, n - 1)] += static_cast<int>(w.Uniform(-1000, 1000));
+      return 0;
+    }
+    auto[l, r] = w.Range(n);
+    int64_t sum = 0;
+    for (size_t j = l; j <= r; ++j) {
+      sum += v[j];
+    }
+    return sum;
+  });
+}
+
+Measurement SparseTableMin(size_t n, Workload& w) {
+  SparseTable<> table(w.Values(n, -1000000, 1000000));
+  return Measure(kOps, [&](size_t) {
+    auto[l, r] = w.Range(n);
+    return table.Min(l, r);
+  });
+}
+
+// построение: ops — число элементов, pool == nullptr — последовательно
+template <class Structure>
+Measurement Build(size_t n, Workload& w, bool parallel) {
+  auto v = w.Values(n, -1000000, 1000000);
+  std::unique_ptr<ThreadPool> pool(parallel ? new ThreadPool : nullptr);
+  auto res = Measure(1, [&](size_t) -> int64_t {
+    if (pool != nullptr) {
+      Structure structure(v, *pool);
+      return structure.Query(0, static_cast<int>(n) - 1);
+    }
+    Structure structure(v);
+    return structure.Query(0, static_cast<int>(n) - 1);
+  });
+  res.ops = n;
+  return res;
+}
+
+struct SparseTableMinQuery : SparseTable<> {  // общий интерфейс Query для Build
+  using SparseTable<>::SparseTable;
+
+  int64_t Query(size_t l, size_t r) const {
+    return Min(l, r);
+  }
+};
+
+Measurement NaiveMin(size_t n, Workload& w) {
+  auto v = w.Values(n, -1000000, 1000000);
+  return Measure(NaiveOps(n), [&](size_t) {
+    auto[l, r] = w.Range(n);
+    return *std::min_element(v.begin() + l, v.begin() + r + 1);
+  });
+}
+
+// умножение N x N: ops — число умножений-сложений N^3, n не используется
+template <typename T, size_t N>
+Measurement MatrixMultiply(size_t, Workload& w, bool parallel) {
+  auto lhs = std::make_unique<Matrix<T, N, N>>();
+  auto rhs = std::make_unique<Matrix<T, N, N>>();
+  for (size_t i = 0; i < N; ++i) {
+    for (size_t j = 0; j < N; ++j) {
+      (*lhs)(i, j) = static_cast<T>(w.Uniform(-100, 100));
+      (*rhs)(i, j) = static_cast<T>(w.Uniform(-100, 100));
+    }
+  }
+  std::unique_ptr<ThreadPool> pool(parallel ? new ThreadPool : nullptr);
+  SetMatrixThreadPool(pool.get());
+  std::unique_ptr<Matrix<T, N, N>> res;
+  auto measurement = Measure(1, [&](size_t) {
+    res.reset(new Matrix<T, N, N>(*lhs * *rhs));  // результат сразу в куче, 1024 x 1024 не влезает в стек
+    return static_cast<int64_t>((*res)(N / 2, N / 3));
+  });
+  SetMatrixThreadPool(nullptr);
+  measurement.ops = N * N * N;
+  return measurement;
+}
+
+// res = a + b * 2 - c: ops — число элементов результата
+template <typename T, size_t N>
+Measurement MatrixElementwise(size_t, Workload& w) {
+  std::unique_ptr<Matrix<T, N, N>> mats[4];
+  for (auto& mat : mats) {
+    mat = std::make_unique<Matrix<T, N, N>>();
+    for (size_t i = 0; i < N; ++i) {
+      for (size_t j = 0; j < N; ++j) {
+        (*mat)(i, j) = static_cast<T>(w.Uniform(-100, 100));
+      }
+    }
+  }
+  auto& [res, a, b, c] = mats;
+  const size_t repeats = 64;
+  auto measurement = Measure(repeats, [&](size_t i) {
+    *res = *a + *b * 2 - *c;
+    (*a)(i % N, 0) += 1;
+    return static_cast<int64_t>((*res)(N / 2, N / 3));
+  });
+  measurement.ops = repeats * N * N;
+  return measurement;
+}
+
+template <typename T>
+Measurement DynMatrixMultiply(size_t n, Workload& w) {
+  DynMatrix<T> lhs(n, n);
+  DynMatrix<T> rhs(n, n);
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      lhs(i, j) = static_cast<T>(w.Uniform(-100, 100));
+      rhs(i, j) = static_cast<T>(w.Uniform(-100, 100));
+    }
+  }
+  auto measurement = Measure(1, [&](size_t) {
+    auto res = lhs * rhs;
+    return static_cast<int64_t>(res(n / 2, n / 3));
+  });
+  measurement.ops = n * n * n;
+  return measurement;
+}
+
+// разложение n x n и решение для одной правой части: ops — n^3 / 3 умножений-сложений
+Measurement DynMatrixSolve(size_t n, Workload& w) {
+  DynMatrix<double> mat(n, n);
+  DynMatrix<double> b(n, 1);
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      mat(i, j) = static_cast<double>(w.Uniform(-100, 100));
+    }
+    b(i, 0) = static_cast<double>(w.Uniform(-100, 100));
+  }
+  auto measurement = Measure(1, [&](size_t) {
+    auto x = Solve(mat, b);
+    return static_cast<int64_t>(x(n / 2, 0) * 1e6);
+  });
+  measurement.ops = n * n * n / 3;
+  return measurement;
+}
+
+// исключение Гаусса по столбцам без блоков: строки пересчитываются целиком на каждом шаге
+Measurement NaiveSolve(size_t n, Workload& w) {
+  std::vector<double> mat(n * (n + 1));  // последний столбец — правая часть
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      mat[i * (n + 1) + j] = static_cast<double>(w.Uniform(-100, 100));
+    }
+    mat[i * (n + 1) + n] = static_cast<double>(w.Uniform(-100, 100));
+  }
+  auto measurement = Measure(1, [&](size_t) {
+    size_t width = n + 1;
+    for (size_t j = 0; j < n; ++j) {
+      size_t pivot = j;
+      for (size_t i = j + 1; i < n; ++i) {
+        if (std::abs(mat[i * width + j]) > std::abs(mat[pivot * width + j])) {
+          pivot = i;
+        }
+      }
+      std::swap_ranges(mat.begin() + j * width, mat.begin() + (j + 1) * width, mat.begin() + pivot * width);
+      for (size_t i = j + 1; i < n; ++i) {
+        double factor = mat[i * width + j] / mat[j * width + j];
+        for (size_t c = j; c < width; ++c) {
+          mat[i * width + c] -= factor * mat[j * width + c];
+        }
+      }
+    }
+    std::vector<double> x(n);
+    for (size_t i = n; i-- > 0;) {
+      double sum = mat[i * width + n];
+      for (size_t c = i + 1; c < n; ++c) {
+        sum -= mat[i * width + c] * x[c];
+      }
+      x[i] = sum / mat[i * width + i];
+    }
+    return static_cast<int64_t>(x[n / 2] * 1e6);
+  });
+  measurement.ops = n * n * n / 3;
+  return measurement;
+}
+
+template <typename T, size_t N>
+Measurement NaiveMatrixMultiply(size_t, Workload& w) {
+  std::vector<T> lhs(N * N);
+  std::vector<T> rhs(N * N);
+  for (size_t i = 0; i < N * N; ++i) {
+    lhs[i] = static_cast<T>(w.Uniform(-100, 100));
+    rhs[i] = static_cast<T>(w.Uniform(-100, 100));
+  }
+  std::vector<T> res(N * N);
+  auto measurement = Measure(1, [&](size_t) {
+    for (size_t i = 0; i < N; ++i) {
+      for (size_t j = 0; j < N; ++j) {
+        T sum = 0;
+        for (size_t k = 0; k < N; ++k) {
+          sum += lhs[i * N + k] * rhs[k * N + j];
+        }
+        res[i * N + j] = sum;
+      }
+    }
+    return static_cast<int64_t>(res[N / 2 * N + N / 3]);
+  });
+  measurement.ops = N * N * N;
+  return measurement;
+}
+
+struct Case {
+  std::string name;
+  Benchmark run;
+  size_t fixed_n = 0;  // если не 0 — размер задан в самом замере, и он идёт один раз с этим n
+};
+
+const std::vector<Case> kCases = {
+    {"cartesian/insert", CartesianInsert},   {"std_set/insert", SetInsert},
+    {"cartesian/erase", CartesianErase},     {"std_set/erase", SetErase},
+    {"cartesian/kth", CartesianKth},         {"std_set/kth", SetKth},
+    {"cartesian/sum_add", CartesianSumAdd},  {"range_fenwick/sum_add", RangeFenwickSumAdd},
+    {"naive/sum_add", NaiveSumAdd},
+    {"segment/max_add", SegmentMaxAdd},      {"segment/batch_max_add", SegmentBatchMaxAdd},
+    {"wide_segment/max_add", WideSegmentMaxAdd},  {"sparse_segment/max_add", SparseSegmentMaxAdd},
+    {"naive/max_add", NaiveMaxAdd},
+    {"fenwick/add_query", FenwickAddQuery<FenwickTree>},
+    {"concurrent_fenwick/add_query", FenwickAddQuery<ConcurrentFenwickTree>},
+    {"naive/add_query", NaiveAddQuery},
+    {"fenwick/lower_bound", FenwickLowerBound},
+    {"sparse_table/min", SparseTableMin},    {"naive/min", NaiveMin},
+    {"fenwick/build", [](size_t n, Workload& w) { return Build<FenwickTree>(n, w, false); }},
+    {"fenwick/parallel_build", [](size_t n, Workload& w) { return Build<FenwickTree>(n, w, true); }},
+    {"sparse_table/build", [](size_t n, Workload& w) { return Build<SparseTableMinQuery>(n, w, false); }},
+    {"sparse_table/parallel_build", [](size_t n, Workload& w) { return Build<SparseTableMinQuery>(n, w, true); }},
+    {"matrix/multiply_double", [](size_t n, Workload& w) { return MatrixMultiply<double, 512>(n, w, false); }, 512},
+    {"naive/multiply_double", NaiveMatrixMultiply<double, 512>, 512},
+    {"matrix/multiply_double", [](size_t n, Workload& w) { return MatrixMultiply<double, 1024>(n, w, false); }, 1024},
+    {"matrix/parallel_mul_double", [](size_t n, Workload& w) { return MatrixMultiply<double, 1024>(n, w, true); }, 1024},
+    {"naive/multiply_double", NaiveMatrixMultiply<double, 1024>, 1024},
+    {"dyn_matrix/multiply_double", DynMatrixMultiply<double>, 1024},
+    {"matrix/elementwise_double", MatrixElementwise<double, 512>, 512},
+    {"dyn_matrix/solve_double", DynMatrixSolve, 1024},
+    {"naive/solve_double", NaiveSolve, 1024},
+    {"matrix/multiply_float", [](size_t n, Workload& w) { return MatrixMultiply<float, 1024>(n, w, false); }, 1024},
+    {"matrix/multiply_int", [](size_t n, Workload& w) { return MatrixMultiply<int, 1024>(n, w, false); }, 1024},
+};
+
+// замер в дочернем процессе: ru_maxrss считается отдельно для каждого
+void RunIsolated(const Case& bench, size_t n, uint64_t seed) {
+  std::cout.flush();
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::perror("fork");
+    return;
+  }
+  if (pid == 0) {
+    Workload w(seed ^ n);
+    auto res = bench.run(n, w);
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    std::printf("%-28s %11zu %10zu %12.1f %10.3f %10.1f %20lld\n", bench.name.c_str(), n, res.ops,
+                res.seconds * 1e9 / res.ops, res.ops / res.seconds / 1e6, usage.ru_maxrss / 1024.0,
+                static_cast<long long>(res.checksum));
+    std::fflush(stdout);
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    std::printf("%-28s %11zu  failed\n", bench.name.c_str(), n);
+  }
+}
+
+int main(int argc, char** argv) {
+  size_t max_n = (argc > 1) ? std::stoull(argv[1]) : 1000000;
+  std::string filter = (argc > 2) ? argv[2] : "";
+  uint64_t seed = (argc > 3) ? std::stoull(argv[3]) : 42;
+
+  std::printf("%-28s %11s %10s %12s %10s %10s %20s\n", "benchmark", "n", "ops", "ns/op", "Mops/s", "rss_mb",
+              "checksum");
+  for (size_t n = 1000; n <= max_n; n *= 10) {
+    for (const auto& bench : kCases) {
+      if (bench.name.find(filter) == std::string::npos) {
+        continue;
+      }
+      if (bench.fixed_n == 0) {
+        RunIsolated(bench, n, seed);
+      } else if (n == 1000) {
+        RunIsolated(bench, bench.fixed_n, seed);
+      }
+    }
+  }
+  return 0;
+}
@@ -1,240 +1,926 @@
-#include <iostream>
-#include <memory>
-
-struct Node {
-  int x;
-  int y;
-  int value;
-  int64_t result = 0;
-  int promise = 0;
-  int size = 1;
-  Node* parent = nullptr;
-  Node* left = nullptr;
-  Node* right = nullptr;
-};
-
-int Size(Node* node_ptr) {
-  return (node_ptr == nullptr) ? 0 : node_ptr->size;
-}
-
-int64_t Result(Node* node_ptr) {
-  return (node_ptr == nullptr) ? 0 : node_ptr->result;
-}
-
-void Push(Node* node_ptr) {
-  if (node_ptr != nullptr) {
-    node_ptr->value += node_ptr->promise;
-    node_ptr->result += node_ptr->promise;
-    if (node_ptr->left != nullptr) {
-      node_ptr->left->promise += node_ptr->promise;
-    }
-    if (node_ptr->right != nullptr) {
-      node_ptr->right->promise += node_ptr->promise;
-    }
-    node_ptr->promise = 0;
-  }
-}
-
-void FixNode(Node* node_ptr) {
-  if (node_ptr != nullptr) {
-    node_ptr->result = Result(node_ptr->left) + node_ptr->result + Result(node_ptr->right);
-    node_ptr->size = Size(node_ptr->left) + 1 + Size(node_ptr->right);
-  }
-}
-
-Node* Merge(Node* left_root, Node* right_root) {
-  if (left_root == nullptr || right_root == nullptr) {
-    return left_root == nullptr ? right_root : left_root;
-  }
-  Push(left_root);
-  if (left_root->y < right_root->y) {
-    left_root->right = Merge(left_root->right, right_root);
-    if (left_root->right != nullptr) {
-      left_root->right->parent = left_root;
-    }
-    FixNode(left_root);
-    return left_root;
-  }
-  Push(right_root);
-  right_root->left = Merge(left_root, right_root->left);
-  if (right_root->left != nullptr) {
-    right_root->left->parent = right_root;
-  }
-  FixNode(right_root);
-  return right_root;
-}
-
-std::tuple<Node*, Node*> Split(Node* root, int k) {
-  if (root == nullptr) {
-    return {nullptr, nullptr};
-  }
-  Push(root);
-  if (Size(root->left) < k) {
-    auto[left, right] = Split(root->right, k);
-    root->right = left;
-    if (left != nullptr) {
-      left->parent = root;
-    }
-    if (right != nullptr) {
-      right->parent = nullptr;
-    }
-    FixNode(root);
-    return {root, right};
-  }
-  auto[left, right] = Split(root->left, k);
-  root->left = right;
-  if (right != nullptr) {
-    right->parent = root;
-  }
-  if (left != nullptr) {
-    left->parent = nullptr;
-  }
-  FixNode(root);
-  return {left, root};
-}
-
-Node* Find(Node* root, int key) {
-  if (root == nullptr || key == root->x) {
-    return root;
-  }
-  if (key < root->x) {
-    return Find(root->left, key);
-  }
-  return Find(root->right, key);
-}
-
-Node* LowerBound(Node* root, int key) {
-  if (root == nullptr || key == root->x) {
-    return root;
-  }
-  if (root->x < key) {
-    return LowerBound(root->right, key);
-  }
-  auto lb = LowerBound(root->left, key);
-  if (lb == nullptr) {
-    return root;
-  }
-  return lb;
-}
-
-Node* NotMore(Node* root, int key) {
-  if (root == nullptr || key == root->x) {
-    return root;
-  }
-  if (root->x > key) {
-    return NotMore(root->left, key);
-  }
-  auto nm = NotMore(root->right, key);
-  if (nm == nullptr) {
-    return root;
-  }
-  return nm;
-}
-
-void Clear(Node* root) {
-  if (root != nullptr) {
-    Clear(root->left);
-    Clear(root->right);
-    delete root;
-  }
-}
-
-int Min(Node* root) {
-  if (root->left == nullptr) {
-    return root->x;
-  }
-  return Min(root->left);
-}
-
-int Max(Node* root) {
-  if (root->right == nullptr) {
-    return root->x;
-  }
-  return Max(root->right);
-}
-
-class CartesianTree {
- private:
-  Node* root_ = nullptr;
-
- public:
-  CartesianTree() = default;
-
-  int64_t Sum(int begin, int end) {  // не включая end
-    if (root_ == nullptr || end <= Min(root_) || Max(root_) < begin) {
-      return 0;
-    }
-    auto[begin_left, begin_right] = Split(root_, begin);
-    auto[sub_root, root_right] = Split(begin_right, end);
-    auto sum = Result(sub_root);
-    root_ = Merge(Merge(begin_left, sub_root), root_right);
-    return sum;
-  }
-
-  void Add(int begin, int end, int delta) {  // не включая end
-    if (root_ == nullptr || end <= Min(root_) || Max(root_) < begin) {
-      return;
-    }
-    auto[begin_left, begin_right] = Split(root_, begin);
-    auto[sub_root, root_right] = Split(begin_right, end);
-    sub_root->promise += delta;
-    root_ = Merge(Merge(begin_left, sub_root), root_right);
-  }
-
-  void Insert(int k, int y) {
-    if (Find(root_, k) == nullptr) {
-      auto node_ptr = new Node{k, y};
-      auto[left, right] = Split(root_, k);
-      root_ = Merge(Merge(left, node_ptr), right);
-    }
-  }
-
-  void Erase(int k) {
-    if (Find(root_, k) != nullptr) {
-      auto[less, not_less] = Split(root_, k);
-      auto[k_ptr, more] = Split(not_less, k + 1);
-      delete k_ptr;
-      root_ = Merge(less, more);
-    }
-  }
-
-  std::string IsExist(int key) {
-    return (Find(root_, key) == nullptr) ? "false" : "true";
-  }
-
-  std::string Next(int key) {
-    auto next = LowerBound(root_, key + 1);
-    if (next != nullptr) {
-      return std::to_string(next->x);
-    }
-    return "none";
-  }
-
-  std::string Prev(int key) {
-    auto prev = NotMore(root_, key - 1);
-    if (prev != nullptr) {
-      return std::to_string(prev->x);
-    }
-    return "none";
-  }
-
-  std::string KthElement(int k) {
-    auto curr_root = root_;
-    while (curr_root != nullptr) {
-      if (Size(curr_root->left) == k) {
-        return std::to_string(curr_root->x);
-      }
-      if (Size(curr_root->left) < k) {
-        k -= Size(curr_root->left) + 1;
-        curr_root = curr_root->right;
-      } else {
-        curr_root = curr_root->left;
-      }
-    }
-    return "none";
-  }
-
-  ~CartesianTree() {
-    Clear(root_);
-  }
-};
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "thread_pool.h"
+
+// Aggregate: Identity, Lift(value), Combine(lhs, rhs) и kScalesWithSize —
+// растёт ли агрегат поддерева пропорционально размеру при прибавке ко всем значениям
+
+template <class T>
+struct SumAggregate {
+  using Type = T;
+  static const bool kScalesWithSize = true;
+
+  static Type Identity() {
+    return 0;
+  }
+
+  template <class Value>
+  static Type Lift(const Value& value) {
+    return value;
+  }
+
+  static Type Combine(const Type& lhs, const Type& rhs) {
+    return lhs + rhs;
+  }
+};
+
+template <class T>
+struct MinAggregate {
+  using Type = T;
+  static const bool kScalesWithSize = false;
+
+  static Type Identity() {
+    return std::numeric_limits<T>::max();
+  }
+
+  template <class Value>
+  static Type Lift(const Value& value) {
+    return value;
+  }
+
+  static Type Combine(const Type& lhs, const Type& rhs) {
+    return std::min(lhs, rhs);
+  }
+};
+
+template <class T>
+struct MaxAggregate {
+  using Type = T;
+  static const bool kScalesWithSize = false;
+
+  static Type Identity() {
+    return std::numeric_limits<T>::lowest();
+  }
+
+  template <class Value>
+  static Type Lift(const Value& value) {
+    return value;
+  }
+
+  static Type Combine(const Type& lhs, const Type& rhs) {
+    return std::max(lhs, rhs);
+  }
+};
+
+struct NoAggregate {
+  struct Type {};
+  static const bool kScalesWithSize = false;
+
+  static Type Identity() {
+    return {};
+  }
+
+  template <class Value>
+  static Type Lift(const Value&) {
+    return {};
+  }
+
+  static Type Combine(const Type&, const Type&) {
+    return {};
+  }
+};
+
+// Lazy: Identity, Compose(older, newer), ApplyValue и ApplyAggregate
+
+template <class T>
+struct AddLazy {
+  using Type = T;
+
+  static Type Identity() {
+    return 0;
+  }
+
+  static Type Compose(const Type& older, const Type& newer) {
+    return older + newer;
+  }
+
+  template <class Value>
+  static void ApplyValue(Value& value, const Type& promise) {
+    value += promise;
+  }
+
+  template <class Aggregate>
+  static void ApplyAggregate(typename Aggregate::Type& result, const Type& promise, int size) {
+    if constexpr (Aggregate::kScalesWithSize) {
+      result += static_cast<typename Aggregate::Type>(promise) * size;
+    } else {
+      result += promise;
+    }
+  }
+};
+
+template <class T>
+struct AssignLazy {
+  using Type = std::optional<T>;
+
+  static Type Identity() {
+    return std::nullopt;
+  }
+
+  static Type Compose(const Type& older, const Type& newer) {
+    return newer.has_value() ? newer : older;
+  }
+
+  template <class Value>
+  static void ApplyValue(Value& value, const Type& promise) {
+    if (promise.has_value()) {
+      value = *promise;
+    }
+  }
+
+  template <class Aggregate>
+  static void ApplyAggregate(typename Aggregate::Type& result, const Type& promise, int size) {
+    if (promise.has_value()) {
+      if constexpr (Aggregate::kScalesWithSize) {
+        result = static_cast<typename Aggregate::Type>(*promise) * size;
+      } else {
+        result = *promise;
+      }
+    }
+  }
+};
+
+struct NoLazy {
+  struct Type {};
+
+  static Type Identity() {
+    return {};
+  }
+
+  static Type Compose(const Type&, const Type&) {
+    return {};
+  }
+
+  template <class Value>
+  static void ApplyValue(Value&, const Type&) {
+  }
+
+  template <class Aggregate>
+  static void ApplyAggregate(typename Aggregate::Type&, const Type&, int) {
+  }
+};
+
+// для пустых типов (NoAggregate, NoLazy) поле не занимает места в узле
+
+template <class T, bool = std::is_empty_v<T>>
+struct ResultField {
+  T result;
+};
+
+template <class T>
+struct ResultField<T, true> {
+  inline static T result{};
+};
+
+template <class T, bool = std::is_empty_v<T>>
+struct PromiseField {
+  T promise;
+};
+
+template <class T>
+struct PromiseField<T, true> {
+  inline static T promise{};
+};
+
+template <class Key, class Value, class Aggregate, class Lazy>
+struct Node : ResultField<typename Aggregate::Type>, PromiseField<typename Lazy::Type> {
+  using KeyType = Key;
+  using ValueType = Value;
+  using AggregateType = Aggregate;
+  using LazyType = Lazy;
+
+  Key x{};
+  int y = 0;
+  Value value{};
+  int size = 1;
+  Key min_x{};  // минимальный и максимальный ключи поддерева
+  Key max_x{};
+  Node* parent = nullptr;
+  Node* left = nullptr;
+  Node* right = nullptr;
+};
+
+template <class N>
+class NodePool {
+ private:
+  static const size_t kBlockSize = 1024;
+
+  std::vector<std::unique_ptr<N[]>> blocks_;
+  size_t used_ = kBlockSize;
+  N* free_ = nullptr;  // освобождённые узлы связаны через left
+
+ public:
+  NodePool() = default;
+
+  NodePool(const NodePool&) = delete;
+
+  NodePool& operator=(const NodePool&) = delete;
+
+  N* Allocate(const typename N::KeyType& x, int y, const typename N::ValueType& value = {}) {
+    N* node_ptr;
+    if (free_ != nullptr) {
+      node_ptr = free_;
+      free_ = free_->left;
+    } else {
+      if (used_ == kBlockSize) {
+        blocks_.emplace_back(new N[kBlockSize]);
+        used_ = 0;
+      }
+      node_ptr = &blocks_.back()[used_++];
+    }
+    *node_ptr = N{};
+    node_ptr->x = x;
+    node_ptr->y = y;
+    node_ptr->value = value;
+    node_ptr->result = N::AggregateType::Lift(value);
+    node_ptr->promise = N::LazyType::Identity();
+    node_ptr->min_x = x;
+    node_ptr->max_x = x;
+    return node_ptr;
+  }
+
+  void Free(N* node_ptr) {
+    node_ptr->left = free_;
+    free_ = node_ptr;
+  }
+
+  // блоки и свободные узлы other переходят к этому пулу; недозаполненный хвост
+  // последнего блока other больше не выдаётся
+  void Absorb(NodePool& other) {
+    auto current = blocks_.empty() ? blocks_.end() : blocks_.end() - 1;
+    blocks_.insert(current, std::make_move_iterator(other.blocks_.begin()),
+                   std::make_move_iterator(other.blocks_.end()));
+    if (other.free_ != nullptr) {
+      auto tail = other.free_;
+      while (tail->left != nullptr) {
+        tail = tail->left;
+      }
+      tail->left = free_;
+      free_ = other.free_;
+    }
+    other.blocks_.clear();
+    other.used_ = kBlockSize;
+    other.free_ = nullptr;
+  }
+};
+
+template <class N>
+int Size(const N* node_ptr) {
+  return (node_ptr == nullptr) ? 0 : node_ptr->size;
+}
+
+// result поддерева с учётом promise самого узла и отложенного promise предков
+template <class N>
+typename N::AggregateType::Type Result(const N* node_ptr,
+                                       const typename N::LazyType::Type& promise = N::LazyType::Identity()) {
+  using Aggregate = typename N::AggregateType;
+  if (node_ptr == nullptr) {
+    return Aggregate::Identity();
+  }
+  auto result = node_ptr->result;
+  if constexpr (!std::is_empty_v<typename Aggregate::Type>) {
+    N::LazyType::template ApplyAggregate<Aggregate>(result, N::LazyType::Compose(node_ptr->promise, promise),
+                                                    node_ptr->size);
+  }
+  return result;
+}
+
+// значение узла с учётом его promise и отложенного promise предков
+template <class N>
+typename N::ValueType Value(const N* node_ptr, const typename N::LazyType::Type& promise) {
+  auto value = node_ptr->value;
+  N::LazyType::ApplyValue(value, N::LazyType::Compose(node_ptr->promise, promise));
+  return value;
+}
+
+template <class N>
+void Push(N* node_ptr) {
+  using Lazy = typename N::LazyType;
+  if constexpr (!std::is_empty_v<typename Lazy::Type>) {
+    if (node_ptr != nullptr) {
+      Lazy::ApplyValue(node_ptr->value, node_ptr->promise);
+      if constexpr (!std::is_empty_v<typename N::AggregateType::Type>) {
+        Lazy::template ApplyAggregate<typename N::AggregateType>(node_ptr->result, node_ptr->promise, node_ptr->size);
+      }
+      if (node_ptr->left != nullptr) {
+        node_ptr->left->promise = Lazy::Compose(node_ptr->left->promise, node_ptr->promise);
+      }
+      if (node_ptr->right != nullptr) {
+        node_ptr->right->promise = Lazy::Compose(node_ptr->right->promise, node_ptr->promise);
+      }
+      node_ptr->promise = Lazy::Identity();
+    }
+  }
+}
+
+template <class N>
+void FixNode(N* node_ptr) {
+  using Aggregate = typename N::AggregateType;
+  if (node_ptr != nullptr) {
+    node_ptr->result = Aggregate::Combine(Aggregate::Combine(Result(node_ptr->left), Aggregate::Lift(node_ptr->value)),
+                                          Result(node_ptr->right));
+    node_ptr->size = Size(node_ptr->left) + 1 + Size(node_ptr->right);
+    node_ptr->min_x = (node_ptr->left == nullptr) ? node_ptr->x : node_ptr->left->min_x;
+    node_ptr->max_x = (node_ptr->right == nullptr) ? node_ptr->x : node_ptr->right->max_x;
+  }
+}
+
+// Merge и Split идут сверху вниз без рекурсии, пересобирая две цепочки узлов, а затем
+// пересчитывают узлы цепочек снизу вверх по parent
+
+template <class N>
+void FixUp(N* node_ptr) {
+  for (; node_ptr != nullptr; node_ptr = node_ptr->parent) {
+    FixNode(node_ptr);
+  }
+}
+
+template <class N>
+N* Merge(N* left_root, N* right_root) {
+  N* root = nullptr;
+  N* owner = nullptr;  // к какому узлу и с какой стороны подвешивать следующий
+  bool as_right = false;
+  auto attach = [&](N* node_ptr) {
+    if (owner == nullptr) {
+      root = node_ptr;
+    } else if (as_right) {
+      owner->right = node_ptr;
+    } else {
+      owner->left = node_ptr;
+    }
+    if (node_ptr != nullptr) {
+      node_ptr->parent = owner;
+    }
+  };
+  while (left_root != nullptr && right_root != nullptr) {
+    if (left_root->y < right_root->y) {
+      Push(left_root);
+      attach(left_root);
+      owner = left_root;
+      as_right = true;
+      left_root = left_root->right;
+    } else {
+      Push(right_root);
+      attach(right_root);
+      owner = right_root;
+      as_right = false;
+      right_root = right_root->left;
+    }
+  }
+  attach(left_root == nullptr ? right_root : left_root);
+  FixUp(owner);
+  return root;
+}
+
+// при inclusive = true ключ k попадает в левую часть
+template <class N>
+std::tuple<N*, N*> Split(N* root, const typename N::KeyType& k, bool inclusive = false) {
+  N* left_root = nullptr;
+  N* right_root = nullptr;
+  N* left_last = nullptr;  // правый край левой части и левый край правой
+  N* right_last = nullptr;
+  while (root != nullptr) {
+    Push(root);
+    if (inclusive ? !(k < root->x) : root->x < k) {
+      if (left_last == nullptr) {
+        left_root = root;
+      } else {
+        left_last->right = root;
+      }
+      root->parent = left_last;
+      left_last = root;
+      root = root->right;
+    } else {
+      if (right_last == nullptr) {
+        right_root = root;
+      } else {
+        right_last->left = root;
+      }
+      root->parent = right_last;
+      right_last = root;
+      root = root->left;
+    }
+  }
+  if (left_last != nullptr) {
+    left_last->right = nullptr;
+  }
+  if (right_last != nullptr) {
+    right_last->left = nullptr;
+  }
+  FixUp(left_last);
+  FixUp(right_last);
+  return {left_root, right_root};
+}
+
+template <class N>
+N* Find(N* root, const typename N::KeyType& key) {
+  while (root != nullptr && !(key == root->x)) {
+    root = (key < root->x) ? root->left : root->right;
+  }
+  return root;
+}
+
+// первый ключ >= key (> key при strict = true)
+template <class N>
+N* LowerBound(N* root, const typename N::KeyType& key, bool strict = false) {
+  N* lb = nullptr;
+  while (root != nullptr) {
+    if (strict ? !(key < root->x) : root->x < key) {
+      root = root->right;
+    } else {
+      lb = root;
+      root = root->left;
+    }
+  }
+  return lb;
+}
+
+// последний ключ <= key (< key при strict = true)
+template <class N>
+N* NotMore(N* root, const typename N::KeyType& key, bool strict = false) {
+  N* nm = nullptr;
+  while (root != nullptr) {
+    if (strict ? !(root->x < key) : key < root->x) {
+      root = root->left;
+    } else {
+      nm = root;
+      root = root->right;
+    }
+  }
+  return nm;
+}
+
+// левые дети поворотами поднимаются наверх, так что узлы освобождаются без стека
+template <class N>
+void Clear(N* root, NodePool<N>& pool) {
+  while (root != nullptr) {
+    if (root->left != nullptr) {
+      auto left = root->left;
+      root->left = left->right;
+      left->right = root;
+      root = left;
+    } else {
+      auto right = root->right;
+      pool.Free(root);
+      root = right;
+    }
+  }
+}
+
+// агрегат по ключам из [begin, end) без перестройки дерева: promise не проталкиваются,
+// а накапливаются по пути спуска
+template <class N>
+typename N::AggregateType::Type Sum(const N* root, const typename N::KeyType& begin,
+                                    const typename N::KeyType& end) {
+  using Aggregate = typename N::AggregateType;
+  using Lazy = typename N::LazyType;
+  auto promise = Lazy::Identity();
+  auto node_ptr = root;
+  while (node_ptr != nullptr && (node_ptr->x < begin || !(node_ptr->x < end))) {
+    promise = Lazy::Compose(node_ptr->promise, promise);
+    node_ptr = (node_ptr->x < begin) ? node_ptr->right : node_ptr->left;
+  }
+  if (node_ptr == nullptr) {
+    return Aggregate::Identity();
+  }
+  if (!(node_ptr->min_x < begin) && node_ptr->max_x < end) {  // поддерево развилки целиком внутри
+    return Result(node_ptr, promise);
+  }
+  auto sum = Aggregate::Lift(Value(node_ptr, promise));
+  promise = Lazy::Compose(node_ptr->promise, promise);
+  auto left_sum = Aggregate::Identity();
+  auto left_promise = promise;
+  for (auto curr = node_ptr->left; curr != nullptr;) {
+    auto curr_promise = Lazy::Compose(curr->promise, left_promise);
+    if (curr->x < begin) {
+      curr = curr->right;
+    } else {
+      auto piece = Aggregate::Combine(Aggregate::Lift(Value(curr, left_promise)), Result(curr->right, curr_promise));
+      left_sum = Aggregate::Combine(piece, left_sum);
+      curr = curr->left;
+    }
+    left_promise = curr_promise;
+  }
+  auto right_sum = Aggregate::Identity();
+  auto right_promise = promise;
+  for (auto curr = node_ptr->right; curr != nullptr;) {
+    auto curr_promise = Lazy::Compose(curr->promise, right_promise);
+    if (!(curr->x < end)) {
+      curr = curr->left;
+    } else {
+      auto piece = Aggregate::Combine(Result(curr->left, curr_promise), Aggregate::Lift(Value(curr, right_promise)));
+      right_sum = Aggregate::Combine(right_sum, piece);
+      curr = curr->right;
+    }
+    right_promise = curr_promise;
+  }
+  return Aggregate::Combine(Aggregate::Combine(left_sum, sum), right_sum);
+}
+
+// пакетные запросы: отсортированные запросы делятся ключом узла между поддеревьями,
+// так что общая часть пути проходится один раз на весь пакет
+
+template <class N, class Iter, class Out>
+void BatchIsExist(const N* node_ptr, Iter begin, Iter end, Out out) {
+  if (begin == end) {
+    return;
+  }
+  if (node_ptr == nullptr) {
+    std::fill(out, out + (end - begin), false);
+    return;
+  }
+  auto equal_begin = std::lower_bound(begin, end, node_ptr->x);
+  auto equal_end = std::upper_bound(equal_begin, end, node_ptr->x);
+  std::fill(out + (equal_begin - begin), out + (equal_end - begin), true);
+  BatchIsExist(node_ptr->left, begin, equal_begin, out);
+  BatchIsExist(node_ptr->right, equal_end, end, out + (equal_end - begin));
+}
+
+template <class N, class Iter, class Out>
+void BatchNext(const N* node_ptr, Iter begin, Iter end, Out out, const N* next) {
+  if (begin == end) {
+    return;
+  }
+  if (node_ptr == nullptr) {
+    std::optional<typename N::KeyType> answer;
+    if (next != nullptr) {
+      answer = next->x;
+    }
+    std::fill(out, out + (end - begin), answer);
+    return;
+  }
+  auto mid = std::lower_bound(begin, end, node_ptr->x);
+  BatchNext(node_ptr->left, begin, mid, out, node_ptr);
+  BatchNext(node_ptr->right, mid, end, out + (mid - begin), next);
+}
+
+template <class N, class Iter, class Out>
+void BatchPrev(const N* node_ptr, Iter begin, Iter end, Out out, const N* prev) {
+  if (begin == end) {
+    return;
+  }
+  if (node_ptr == nullptr) {
+    std::optional<typename N::KeyType> answer;
+    if (prev != nullptr) {
+      answer = prev->x;
+    }
+    std::fill(out, out + (end - begin), answer);
+    return;
+  }
+  auto mid = std::upper_bound(begin, end, node_ptr->x);
+  BatchPrev(node_ptr->left, begin, mid, out, prev);
+  BatchPrev(node_ptr->right, mid, end, out + (mid - begin), node_ptr);
+}
+
+// offset — число ключей левее поддерева node_ptr
+template <class N, class Iter, class Out>
+void BatchKthElement(const N* node_ptr, Iter begin, Iter end, Out out, int offset) {
+  if (begin == end) {
+    return;
+  }
+  if (node_ptr == nullptr) {
+    std::fill(out, out + (end - begin), std::optional<typename N::KeyType>{});
+    return;
+  }
+  int k = offset + Size(node_ptr->left);
+  auto equal_begin = std::lower_bound(begin, end, k);
+  auto equal_end = std::upper_bound(equal_begin, end, k);
+  std::fill(out + (equal_begin - begin), out + (equal_end - begin), std::optional<typename N::KeyType>{node_ptr->x});
+  BatchKthElement(node_ptr->left, begin, equal_begin, out, offset);
+  BatchKthElement(node_ptr->right, equal_end, end, out + (equal_end - begin), k + 1);
+}
+
+// операции над множествами по схеме join: корень с меньшим y остаётся корнем, второе дерево
+// режется по его ключу, половины обрабатываются независимо (в пуле, если он передан).
+// Удалённые узлы складываются в trash: по одному узлу или целыми поддеревьями
+
+const int kParallelThreshold = 1 << 12;
+
+template <class F, class G>
+void Fork(ThreadPool* pool, int size, F&& f, G&& g) {
+  if (pool != nullptr && size >= kParallelThreshold) {
+    ParallelInvoke(*pool, f, g);
+  } else {
+    f();
+    g();
+  }
+}
+
+template <class N>
+void Attach(N* root, N* left, N* right) {
+  root->left = left;
+  root->right = right;
+  if (left != nullptr) {
+    left->parent = root;
+  }
+  if (right != nullptr) {
+    right->parent = root;
+  }
+  FixNode(root);
+}
+
+// SplitOut: (< key, узел с ключом key или nullptr, > key)
+template <class N>
+std::tuple<N*, N*, N*> SplitOut(N* root, const typename N::KeyType& key) {
+  auto[less, not_less] = Split(root, key);
+  auto[equal, greater] = Split(not_less, key, true);
+  return {less, equal, greater};
+}
+
+template <class N>
+void Drop(N* node_ptr, std::vector<N*>& trash) {
+  if (node_ptr != nullptr) {
+    trash.push_back(node_ptr);
+  }
+}
+
+template <class N>
+void DropSingle(N* node_ptr, std::vector<N*>& trash) {
+  node_ptr->left = nullptr;
+  node_ptr->right = nullptr;
+  trash.push_back(node_ptr);
+}
+
+// при совпадении ключей остаётся узел lhs (keep_lhs) или значение из rhs
+template <class N>
+N* Union(N* lhs, N* rhs, std::vector<N*>& trash, ThreadPool* pool, bool keep_lhs = true) {
+  if (lhs == nullptr || rhs == nullptr) {
+    return lhs == nullptr ? rhs : lhs;
+  }
+  if (rhs->y < lhs->y) {
+    std::swap(lhs, rhs);
+    keep_lhs = !keep_lhs;
+  }
+  Push(lhs);
+  auto[less, equal, greater] = SplitOut(rhs, lhs->x);
+  if (equal != nullptr) {
+    if (!keep_lhs) {
+      lhs->value = equal->value;
+    }
+    DropSingle(equal, trash);
+  }
+  N* left = nullptr;
+  N* right = nullptr;
+  std::vector<N*> right_trash;
+  Fork(
+      pool, Size(lhs) + Size(less) + Size(greater),
+      [&] { left = Union(lhs->left, less, trash, pool, keep_lhs); },
+      [&] { right = Union(lhs->right, greater, right_trash, pool, keep_lhs); });
+  trash.insert(trash.end(), right_trash.begin(), right_trash.end());
+  Attach(lhs, left, right);
+  return lhs;
+}
+
+// остаются узлы с ключами из обоих деревьев; значение берётся из lhs (keep_lhs) или из rhs
+template <class N>
+N* Intersect(N* lhs, N* rhs, std::vector<N*>& trash, ThreadPool* pool, bool keep_lhs = true) {
+  if (lhs == nullptr || rhs == nullptr) {
+    Drop(lhs, trash);
+    Drop(rhs, trash);
+    return nullptr;
+  }
+  if (rhs->y < lhs->y) {
+    std::swap(lhs, rhs);
+    keep_lhs = !keep_lhs;
+  }
+  Push(lhs);
+  auto[less, equal, greater] = SplitOut(rhs, lhs->x);
+  N* left = nullptr;
+  N* right = nullptr;
+  std::vector<N*> right_trash;
+  Fork(
+      pool, Size(lhs) + Size(less) + Size(greater),
+      [&] { left = Intersect(lhs->left, less, trash, pool, keep_lhs); },
+      [&] { right = Intersect(lhs->right, greater, right_trash, pool, keep_lhs); });
+  trash.insert(trash.end(), right_trash.begin(), right_trash.end());
+  if (equal == nullptr) {
+    DropSingle(lhs, trash);
+    auto root = Merge(left, right);
+    if (root != nullptr) {
+      root->parent = nullptr;
+    }
+    return root;
+  }
+  if (!keep_lhs) {
+    lhs->value = equal->value;
+  }
+  DropSingle(equal, trash);
+  Attach(lhs, left, right);
+  return lhs;
+}
+
+// остаются узлы lhs, ключей которых нет в rhs
+template <class N>
+N* Difference(N* lhs, N* rhs, std::vector<N*>& trash, ThreadPool* pool) {
+  if (lhs == nullptr || rhs == nullptr) {
+    Drop(rhs, trash);
+    return lhs;
+  }
+  Push(lhs);
+  auto[less, equal, greater] = SplitOut(rhs, lhs->x);
+  N* left = nullptr;
+  N* right = nullptr;
+  std::vector<N*> right_trash;
+  Fork(
+      pool, Size(lhs) + Size(less) + Size(greater),
+      [&] { left = Difference(lhs->left, less, trash, pool); },
+      [&] { right = Difference(lhs->right, greater, right_trash, pool); });
+  trash.insert(trash.end(), right_trash.begin(), right_trash.end());
+  if (equal == nullptr) {
+    Attach(lhs, left, right);
+    return lhs;
+  }
+  DropSingle(equal, trash);
+  DropSingle(lhs, trash);
+  auto root = Merge(left, right);
+  if (root != nullptr) {
+    root->parent = nullptr;
+  }
+  return root;
+}
+
+template <class Key = int, class Value = int, class Aggregate = SumAggregate<int64_t>, class Lazy = AddLazy<int>>
+class CartesianTree {
+ private:
+  using Node = ::Node<Key, Value, Aggregate, Lazy>;
+
+  NodePool<Node> pool_;
+  Node* root_ = nullptr;
+
+  template <class Operation>
+  void SetOperation(CartesianTree& other, Operation operation) {
+    if (this == &other) {  // A ∪ A = A ∩ A = A; Difference разбирает этот случай сам
+      return;
+    }
+    std::vector<Node*> trash;
+    root_ = operation(trash);
+    if (root_ != nullptr) {
+      root_->parent = nullptr;
+    }
+    other.root_ = nullptr;
+    pool_.Absorb(other.pool_);
+    for (auto root : trash) {
+      Clear(root, pool_);
+    }
+  }
+
+ public:
+  CartesianTree() = default;
+
+  template <class Iter>
+  void Build(Iter begin, Iter end) {  // пары (x, y), x строго возрастают
+    Clear(root_, pool_);
+    root_ = nullptr;
+    std::vector<Node*> right_spine;
+    for (; begin != end; ++begin) {
+      auto node_ptr = pool_.Allocate(begin->first, begin->second);
+      Node* last = nullptr;
+      while (!right_spine.empty() && right_spine.back()->y > node_ptr->y) {
+        last = right_spine.back();
+        right_spine.pop_back();
+        FixNode(last);
+      }
+      node_ptr->left = last;
+      if (last != nullptr) {
+        last->parent = node_ptr;
+      }
+      if (!right_spine.empty()) {
+        right_spine.back()->right = node_ptr;
+        node_ptr->parent = right_spine.back();
+      }
+      right_spine.push_back(node_ptr);
+    }
+    if (!right_spine.empty()) {
+      root_ = right_spine.front();
+    }
+    while (!right_spine.empty()) {
+      FixNode(right_spine.back());
+      right_spine.pop_back();
+    }
+  }
+
+  typename Aggregate::Type Sum(const Key& begin, const Key& end) const {  // не включая end
+    if (root_ == nullptr || !(root_->min_x < end) || root_->max_x < begin) {
+      return Aggregate::Identity();
+    }
+    return ::Sum(root_, begin, end);
+  }
+
+  void Add(const Key& begin, const Key& end, const typename Lazy::Type& delta) {  // не включая end
+    static_assert(!std::is_empty_v<typename Lazy::Type>, "Add requires a lazy operation");
+    if (root_ == nullptr || !(root_->min_x < end) || root_->max_x < begin) {
+      return;
+    }
+    auto[begin_left, begin_right] = Split(root_, begin);
+    auto[sub_root, root_right] = Split(begin_right, end);
+    if (sub_root != nullptr) {
+      sub_root->promise = Lazy::Compose(sub_root->promise, delta);
+    }
+    root_ = Merge(Merge(begin_left, sub_root), root_right);
+  }
+
+  void Insert(const Key& k, int y, const Value& value = {}) {
+    if (Find(root_, k) == nullptr) {
+      auto node_ptr = pool_.Allocate(k, y, value);
+      auto[left, right] = Split(root_, k);
+      root_ = Merge(Merge(left, node_ptr), right);
+    }
+  }
+
+  void Erase(const Key& k) {
+    if (Find(root_, k) != nullptr) {
+      auto[less, not_less] = Split(root_, k);
+      auto[k_ptr, more] = Split(not_less, k, true);
+      pool_.Free(k_ptr);
+      root_ = Merge(less, more);
+    }
+  }
+
+  bool IsExist(const Key& key) const {
+    return Find(root_, key) != nullptr;
+  }
+
+  std::optional<Key> Next(const Key& key) const {
+    auto next = LowerBound(root_, key, true);
+    if (next != nullptr) {
+      return next->x;
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Key> Prev(const Key& key) const {
+    auto prev = NotMore(root_, key, true);
+    if (prev != nullptr) {
+      return prev->x;
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Key> KthElement(int k) const {
+    auto curr_root = root_;
+    while (curr_root != nullptr) {
+      if (Size(curr_root->left) == k) {
+        return curr_root->x;
+      }
+      if (Size(curr_root->left) < k) {
+        k -= Size(curr_root->left) + 1;
+        curr_root = curr_root->right;
+      } else {
+        curr_root = curr_root->left;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // пакетные запросы: [begin, end) отсортированы по возрастанию, ответ на *(begin + i)
+  // пишется в *(out + i), out — итератор произвольного доступа
+  template <class Iter, class Out>
+  void IsExist(Iter begin, Iter end, Out out) const {
+    BatchIsExist(static_cast<const Node*>(root_), begin, end, out);
+  }
+
+  template <class Iter, class Out>
+  void Next(Iter begin, Iter end, Out out) const {
+    BatchNext(static_cast<const Node*>(root_), begin, end, out, static_cast<const Node*>(nullptr));
+  }
+
+  template <class Iter, class Out>
+  void Prev(Iter begin, Iter end, Out out) const {
+    BatchPrev(static_cast<const Node*>(root_), begin, end, out, static_cast<const Node*>(nullptr));
+  }
+
+  template <class Iter, class Out>
+  void KthElement(Iter begin, Iter end, Out out) const {
+    BatchKthElement(static_cast<const Node*>(root_), begin, end, out, 0);
+  }
+
+  // Union, Intersect и Difference забирают узлы other, после них other пусто;
+  // при совпадении ключей сохраняется значение из этого дерева
+  void Union(CartesianTree&& other, ThreadPool* pool = nullptr) {
+    SetOperation(other, [&](std::vector<Node*>& trash) { return ::Union(root_, other.root_, trash, pool); });
+  }
+
+  void Intersect(CartesianTree&& other, ThreadPool* pool = nullptr) {
+    SetOperation(other, [&](std::vector<Node*>& trash) { return ::Intersect(root_, other.root_, trash, pool); });
+  }
+
+  void Difference(CartesianTree&& other, ThreadPool* pool = nullptr) {
+    if (this == &other) {  // A \ A пусто
+      Clear(root_, pool_);
+      root_ = nullptr;
+      return;
+    }
+    SetOperation(other, [&](std::vector<Node*>& trash) { return ::Difference(root_, other.root_, trash, pool); });
+  }
+
+  ~CartesianTree() = default;  // узлы освобождаются вместе с блоками pool_
+};
@@ -0,0 +1,393 @@
+#pragma once
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "cartesian_tree.h"
+
+// то же декартово дерево, но узлы лежат в массивах и адресуются 32-битными индексами:
+// горячие поля (ключи, приоритеты, дети) отдельно от холодных (значения, агрегаты, promise, размеры);
+// индекс 0 — пустой узел, ссылки на родителя нет
+template <class Key = int, class Value = int, class Aggregate = SumAggregate<int64_t>, class Lazy = AddLazy<int>>
+class CompactCartesianTree {
+ private:
+  using AggregateValue = typename Aggregate::Type;
+  using Promise = typename Lazy::Type;
+
+  static constexpr uint32_t kNull = 0;
+  static constexpr bool kHasResult = !std::is_empty_v<AggregateValue>;
+  static constexpr bool kHasPromise = !std::is_empty_v<Promise>;
+
+  struct Children {
+    uint32_t left = kNull;
+    uint32_t right = kNull;
+  };
+
+  std::vector<Key> x_{Key{}};
+  std::vector<int> y_{0};
+  std::vector<Children> children_{Children{}};
+
+  std::vector<Value> values_{Value{}};
+  std::vector<AggregateValue> results_;
+  std::vector<Promise> promises_;
+  std::vector<int> sizes_{0};
+
+  uint32_t root_ = kNull;
+  uint32_t free_ = kNull;  // освобождённые узлы связаны через left
+
+  uint32_t& Left(uint32_t idx) {
+    return children_[idx].left;
+  }
+
+  uint32_t& Right(uint32_t idx) {
+    return children_[idx].right;
+  }
+
+  uint32_t Left(uint32_t idx) const {
+    return children_[idx].left;
+  }
+
+  uint32_t Right(uint32_t idx) const {
+    return children_[idx].right;
+  }
+
+  Promise GetPromise(uint32_t idx) const {
+    if constexpr (kHasPromise) {
+      return promises_[idx];
+    } else {
+      return Lazy::Identity();
+    }
+  }
+
+  uint32_t Allocate(const Key& x, int y, const Value& value) {
+    uint32_t idx = free_;
+    if (idx != kNull) {
+      free_ = Left(idx);
+    } else {
+      idx = static_cast<uint32_t>(x_.size());
+      x_.emplace_back();
+      y_.emplace_back();
+      children_.emplace_back();
+      values_.emplace_back();
+      sizes_.emplace_back();
+      if constexpr (kHasResult) {
+        results_.emplace_back();
+      }
+      if constexpr (kHasPromise) {
+        promises_.emplace_back();
+      }
+    }
+    x_[idx] = x;
+    y_[idx] = y;
+    children_[idx] = Children{};
+    values_[idx] = value;
+    sizes_[idx] = 1;
+    if constexpr (kHasResult) {
+      results_[idx] = Aggregate::Lift(value);
+    }
+    if constexpr (kHasPromise) {
+      promises_[idx] = Lazy::Identity();
+    }
+    return idx;
+  }
+
+  void Free(uint32_t idx) {
+    Left(idx) = free_;
+    free_ = idx;
+  }
+
+  int Size(uint32_t idx) const {
+    return sizes_[idx];
+  }
+
+  AggregateValue Result(uint32_t idx, const Promise& promise = Lazy::Identity()) const {
+    if (idx == kNull) {
+      return Aggregate::Identity();
+    }
+    if constexpr (kHasResult) {
+      auto result = results_[idx];
+      Lazy::template ApplyAggregate<Aggregate>(result, Lazy::Compose(GetPromise(idx), promise), sizes_[idx]);
+      return result;
+    } else {
+      return Aggregate::Identity();
+    }
+  }
+
+  Value GetValue(uint32_t idx, const Promise& promise) const {
+    auto value = values_[idx];
+    Lazy::ApplyValue(value, Lazy::Compose(GetPromise(idx), promise));
+    return value;
+  }
+
+  void Push(uint32_t idx) {
+    if constexpr (kHasPromise) {
+      if (idx != kNull) {
+        auto& promise = promises_[idx];
+        Lazy::ApplyValue(values_[idx], promise);
+        if constexpr (kHasResult) {
+          Lazy::template ApplyAggregate<Aggregate>(results_[idx], promise, sizes_[idx]);
+        }
+        if (Left(idx) != kNull) {
+          promises_[Left(idx)] = Lazy::Compose(promises_[Left(idx)], promise);
+        }
+        if (Right(idx) != kNull) {
+          promises_[Right(idx)] = Lazy::Compose(promises_[Right(idx)], promise);
+        }
+        promise = Lazy::Identity();
+      }
+    }
+  }
+
+  void FixNode(uint32_t idx) {
+    if (idx != kNull) {
+      if constexpr (kHasResult) {
+        results_[idx] = Aggregate::Combine(Aggregate::Combine(Result(Left(idx)), Aggregate::Lift(values_[idx])),
+                                           Result(Right(idx)));
+      }
+      sizes_[idx] = Size(Left(idx)) + 1 + Size(Right(idx));
+    }
+  }
+
+  uint32_t Merge(uint32_t left_root, uint32_t right_root) {
+    if (left_root == kNull || right_root == kNull) {
+      return left_root == kNull ? right_root : left_root;
+    }
+    Push(left_root);
+    if (y_[left_root] < y_[right_root]) {
+      auto right = Merge(Right(left_root), right_root);
+      Right(left_root) = right;
+      FixNode(left_root);
+      return left_root;
+    }
+    Push(right_root);
+    auto left = Merge(left_root, Left(right_root));
+    Left(right_root) = left;
+    FixNode(right_root);
+    return right_root;
+  }
+
+  std::tuple<uint32_t, uint32_t> Split(uint32_t root, const Key& k, bool inclusive = false) {
+    if (root == kNull) {
+      return {kNull, kNull};
+    }
+    Push(root);
+    if (inclusive ? !(k < x_[root]) : x_[root] < k) {
+      auto[left, right] = Split(Right(root), k, inclusive);
+      Right(root) = left;
+      FixNode(root);
+      return {root, right};
+    }
+    auto[left, right] = Split(Left(root), k, inclusive);
+    Left(root) = right;
+    FixNode(root);
+    return {left, root};
+  }
+
+  uint32_t Find(const Key& key) const {
+    auto curr = root_;
+    while (curr != kNull && !(key == x_[curr])) {
+      curr = (key < x_[curr]) ? Left(curr) : Right(curr);
+    }
+    return curr;
+  }
+
+  uint32_t LowerBound(const Key& key, bool strict) const {
+    auto res = kNull;
+    for (auto curr = root_; curr != kNull;) {
+      if (strict ? !(key < x_[curr]) : x_[curr] < key) {
+        curr = Right(curr);
+      } else {
+        res = curr;
+        curr = Left(curr);
+      }
+    }
+    return res;
+  }
+
+  uint32_t NotMore(const Key& key, bool strict) const {
+    auto res = kNull;
+    for (auto curr = root_; curr != kNull;) {
+      if (strict ? !(x_[curr] < key) : key < x_[curr]) {
+        curr = Left(curr);
+      } else {
+        res = curr;
+        curr = Right(curr);
+      }
+    }
+    return res;
+  }
+
+ public:
+  CompactCartesianTree() {
+    if constexpr (kHasResult) {
+      results_.emplace_back(Aggregate::Identity());
+    }
+    if constexpr (kHasPromise) {
+      promises_.emplace_back(Lazy::Identity());
+    }
+  }
+
+  void Reserve(size_t count) {
+    x_.reserve(count);
+    y_.reserve(count);
+    children_.reserve(count);
+    values_.reserve(count);
+    sizes_.reserve(count);
+    if constexpr (kHasResult) {
+      results_.reserve(count);
+    }
+    if constexpr (kHasPromise) {
+      promises_.reserve(count);
+    }
+  }
+
+  template <class Iter>
+  void Build(Iter begin, Iter end) {  // пары (x, y), x строго возрастают
+    x_.resize(1);
+    y_.resize(1);
+    children_.resize(1);
+    values_.resize(1);
+    sizes_.resize(1);
+    if constexpr (kHasResult) {
+      results_.resize(1);
+    }
+    if constexpr (kHasPromise) {
+      promises_.resize(1);
+    }
+    root_ = kNull;
+    free_ = kNull;
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                                    typename std::iterator_traits<Iter>::iterator_category>) {
+      Reserve(x_.size() + std::distance(begin, end));
+    }
+    std::vector<uint32_t> right_spine;
+    for (; begin != end; ++begin) {
+      auto idx = Allocate(begin->first, begin->second, Value{});
+      auto last = kNull;
+      while (!right_spine.empty() && y_[right_spine.back()] > y_[idx]) {
+        last = right_spine.back();
+        right_spine.pop_back();
+        FixNode(last);
+      }
+      Left(idx) = last;
+      if (!right_spine.empty()) {
+        Right(right_spine.back()) = idx;
+      }
+      right_spine.push_back(idx);
+    }
+    if (!right_spine.empty()) {
+      root_ = right_spine.front();
+    }
+    while (!right_spine.empty()) {
+      FixNode(right_spine.back());
+      right_spine.pop_back();
+    }
+  }
+
+  AggregateValue Sum(const Key& begin, const Key& end) const {  // не включая end
+    auto promise = Lazy::Identity();
+    auto idx = root_;
+    while (idx != kNull && (x_[idx] < begin || !(x_[idx] < end))) {
+      promise = Lazy::Compose(GetPromise(idx), promise);
+      idx = (x_[idx] < begin) ? Right(idx) : Left(idx);
+    }
+    if (idx == kNull) {
+      return Aggregate::Identity();
+    }
+    auto sum = Aggregate::Lift(GetValue(idx, promise));
+    promise = Lazy::Compose(GetPromise(idx), promise);
+    auto left_sum = Aggregate::Identity();
+    auto left_promise = promise;
+    for (auto curr = Left(idx); curr != kNull;) {
+      auto curr_promise = Lazy::Compose(GetPromise(curr), left_promise);
+      if (x_[curr] < begin) {
+        curr = Right(curr);
+      } else {
+        auto piece = Aggregate::Combine(Aggregate::Lift(GetValue(curr, left_promise)), Result(Right(curr), curr_promise));
+        left_sum = Aggregate::Combine(piece, left_sum);
+        curr = Left(curr);
+      }
+      left_promise = curr_promise;
+    }
+    auto right_sum = Aggregate::Identity();
+    auto right_promise = promise;
+    for (auto curr = Right(idx); curr != kNull;) {
+      auto curr_promise = Lazy::Compose(GetPromise(curr), right_promise);
+      if (!(x_[curr] < end)) {
+        curr = Left(curr);
+      } else {
+        auto piece = Aggregate::Combine(Result(Left(curr), curr_promise), Aggregate::Lift(GetValue(curr, right_promise)));
+        right_sum = Aggregate::Combine(right_sum, piece);
+        curr = Right(curr);
+      }
+      right_promise = curr_promise;
+    }
+    return Aggregate::Combine(Aggregate::Combine(left_sum, sum), right_sum);
+  }
+
+  void Add(const Key& begin, const Key& end, const Promise& delta) {  // не включая end
+    static_assert(kHasPromise, "Add requires a lazy operation");
+    auto[begin_left, begin_right] = Split(root_, begin);
+    auto[sub_root, root_right] = Split(begin_right, end);
+    if (sub_root != kNull) {
+      promises_[sub_root] = Lazy::Compose(promises_[sub_root], delta);
+    }
+    root_ = Merge(Merge(begin_left, sub_root), root_right);
+  }
+
+  void Insert(const Key& k, int y, const Value& value = {}) {
+    if (Find(k) == kNull) {
+      auto idx = Allocate(k, y, value);
+      auto[left, right] = Split(root_, k);
+      root_ = Merge(Merge(left, idx), right);
+    }
+  }
+
+  void Erase(const Key& k) {
+    if (Find(k) != kNull) {
+      auto[less, not_less] = Split(root_, k);
+      auto[k_idx, more] = Split(not_less, k, true);
+      Free(k_idx);
+      root_ = Merge(less, more);
+    }
+  }
+
+  bool IsExist(const Key& key) const {
+    return Find(key) != kNull;
+  }
+
+  std::optional<Key> Next(const Key& key) const {
+    auto next = LowerBound(key, true);
+    if (next != kNull) {
+      return x_[next];
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Key> Prev(const Key& key) const {
+    auto prev = NotMore(key, true);
+    if (prev != kNull) {
+      return x_[prev];
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Key> KthElement(int k) const {
+    auto curr = root_;
+    while (curr != kNull) {
+      if (Size(Left(curr)) == k) {
+        return x_[curr];
+      }
+      if (Size(Left(curr)) < k) {
+        k -= Size(Left(curr)) + 1;
+        curr = Right(curr);
+      } else {
+        curr = Left(curr);
+      }
+    }
+    return std::nullopt;
+  }
+};
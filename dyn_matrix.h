@@ -0,0 +1,315 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "matrix.h"
+
+// память под строки выровнена по кэш-линии, чтобы векторные загрузки в ядре умножения
+// не пересекали её границу
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator {
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() = default;
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>&) {  // NOLINT
+  }
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+  }
+
+  void deallocate(T* ptr, size_t) {
+    ::operator delete(ptr, std::align_val_t(Alignment));
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment>&) const {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment>&) const {
+    return false;
+  }
+};
+
+// матрица с размерами во время выполнения: элементы лежат по строкам в куче, поэтому
+// размер не ограничен стеком, а перемещение стоит O(1). Операции с несовпадающими
+// размерами бросают MatrixSizeMismatch
+template <typename T>
+class DynMatrix {
+ private:
+  size_t rows_ = 0;
+  size_t columns_ = 0;
+  std::vector<T, AlignedAllocator<T>> data_;
+
+  void CheckSameSize(const DynMatrix& other) const {
+    if (rows_ != other.rows_ || columns_ != other.columns_) {
+      throw MatrixSizeMismatch{};
+    }
+  }
+
+ public:
+  DynMatrix() = default;
+
+  DynMatrix(size_t rows, size_t columns, const T& value = T{})
+      : rows_(rows), columns_(columns), data_(rows * columns, value) {
+  }
+
+  template <size_t R, size_t C>
+  explicit DynMatrix(const Matrix<T, R, C>& mat) : rows_(R), columns_(C), data_(&mat.arr[0][0], &mat.arr[0][0] + R * C) {
+  }
+
+  // Matrix<T, R, C> — агрегат, поэтому копируем поэлементно; размер должен совпадать
+  template <size_t R, size_t C>
+  explicit operator Matrix<T, R, C>() const {
+    if (rows_ != R || columns_ != C) {
+      throw MatrixSizeMismatch{};
+    }
+    Matrix<T, R, C> res;
+    std::copy(data_.begin(), data_.end(), &res.arr[0][0]);
+    return res;
+  }
+
+  size_t RowsNumber() const {
+    return rows_;
+  }
+
+  size_t ColumnsNumber() const {
+    return columns_;
+  }
+
+  T* Data() {
+    return data_.data();
+  }
+
+  const T* Data() const {
+    return data_.data();
+  }
+
+  T& operator()(size_t i, size_t j) {
+    return data_[i * columns_ + j];
+  }
+
+  const T& operator()(size_t i, size_t j) const {
+    return data_[i * columns_ + j];
+  }
+
+  T& At(size_t i, size_t j) {
+    if (i >= rows_ || j >= columns_) {
+      throw MatrixOutOfRange{};
+    }
+    return data_[i * columns_ + j];
+  }
+
+  const T& At(size_t i, size_t j) const {
+    if (i >= rows_ || j >= columns_) {
+      throw MatrixOutOfRange{};
+    }
+    return data_[i * columns_ + j];
+  }
+
+  DynMatrix& operator+=(const DynMatrix& other) {
+    CheckSameSize(other);
+    ForRowBlocks(rows_, data_.size(), [&](size_t from, size_t to) {
+      for (size_t i = from * columns_; i < to * columns_; ++i) {
+        data_[i] += other.data_[i];
+      }
+    });
+    return *this;
+  }
+
+  DynMatrix& operator-=(const DynMatrix& other) {
+    CheckSameSize(other);
+    ForRowBlocks(rows_, data_.size(), [&](size_t from, size_t to) {
+      for (size_t i = from * columns_; i < to * columns_; ++i) {
+        data_[i] -= other.data_[i];
+      }
+    });
+    return *this;
+  }
+
+  DynMatrix& operator*=(const DynMatrix& other) {
+    if (columns_ != other.rows_) {
+      throw MatrixSizeMismatch{};
+    }
+    DynMatrix res(rows_, other.columns_);
+    ParallelMultiplyAdd(rows_, columns_, other.columns_, Data(), columns_, other.Data(), other.columns_, res.Data(),
+                        other.columns_);
+    return *this = std::move(res);
+  }
+
+  template <typename U>
+  DynMatrix& operator*=(const U& num) {
+    ForRowBlocks(rows_, data_.size(), [&](size_t from, size_t to) {
+      for (size_t i = from * columns_; i < to * columns_; ++i) {
+        data_[i] *= num;
+      }
+    });
+    return *this;
+  }
+
+  template <typename U>
+  DynMatrix& operator/=(const U& num) {
+    ForRowBlocks(rows_, data_.size(), [&](size_t from, size_t to) {
+      for (size_t i = from * columns_; i < to * columns_; ++i) {
+        data_[i] /= num;
+      }
+    });
+    return *this;
+  }
+};
+
+template <typename T>
+DynMatrix<T> GetTransposed(const DynMatrix<T>& mat) {
+  DynMatrix<T> transposed(mat.ColumnsNumber(), mat.RowsNumber());
+  ForRowBlocks(mat.RowsNumber(), mat.RowsNumber() * mat.ColumnsNumber(), [&](size_t from, size_t to) {
+    for (size_t i = from; i < to; ++i) {
+      for (size_t j = 0; j < mat.ColumnsNumber(); ++j) {
+        transposed(j, i) = mat(i, j);
+      }
+    }
+  });
+  return transposed;
+}
+
+// левый операнд по значению: временная матрица слева переиспользуется без копии
+template <typename T>
+DynMatrix<T> operator+(DynMatrix<T> lhs, const DynMatrix<T>& rhs) {
+  lhs += rhs;
+  return lhs;
+}
+
+template <typename T>
+DynMatrix<T> operator-(DynMatrix<T> lhs, const DynMatrix<T>& rhs) {
+  lhs -= rhs;
+  return lhs;
+}
+
+template <typename T>
+DynMatrix<T> operator*(const DynMatrix<T>& lhs, const DynMatrix<T>& rhs) {
+  if (lhs.ColumnsNumber() != rhs.RowsNumber()) {
+    throw MatrixSizeMismatch{};
+  }
+  DynMatrix<T> res(lhs.RowsNumber(), rhs.ColumnsNumber());
+  ParallelMultiplyAdd(lhs.RowsNumber(), lhs.ColumnsNumber(), rhs.ColumnsNumber(), lhs.Data(), lhs.ColumnsNumber(),
+                      rhs.Data(), rhs.ColumnsNumber(), res.Data(), res.ColumnsNumber());
+  return res;
+}
+
+template <typename T, typename U>
+DynMatrix<T> operator*(DynMatrix<T> mat, const U& num) {
+  mat *= num;
+  return mat;
+}
+
+template <typename T, typename U>
+DynMatrix<T> operator*(const U& num, DynMatrix<T> mat) {
+  mat *= num;
+  return mat;
+}
+
+template <typename T, typename U>
+DynMatrix<T> operator/(DynMatrix<T> mat, const U& num) {
+  mat /= num;
+  return mat;
+}
+
+template <typename T, typename U>
+DynMatrix<T> operator/(const U& num, DynMatrix<T> mat) {
+  mat /= num;
+  return mat;
+}
+
+template <typename T>
+bool operator==(const DynMatrix<T>& lhs, const DynMatrix<T>& rhs) {
+  if (lhs.RowsNumber() != rhs.RowsNumber() || lhs.ColumnsNumber() != rhs.ColumnsNumber()) {
+    return false;
+  }
+  return std::equal(lhs.Data(), lhs.Data() + lhs.RowsNumber() * lhs.ColumnsNumber(), rhs.Data());
+}
+
+template <typename T>
+bool operator!=(const DynMatrix<T>& lhs, const DynMatrix<T>& rhs) {
+  return !(lhs == rhs);
+}
+
+template <typename T>
+std::istream& operator>>(std::istream& is, DynMatrix<T>& mat) {  // размер задан заранее
+  for (size_t i = 0; i < mat.RowsNumber(); ++i) {
+    for (size_t j = 0; j < mat.ColumnsNumber(); ++j) {
+      is >> mat(i, j);
+    }
+  }
+  return is;
+}
+
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const DynMatrix<T>& mat) {
+  for (size_t i = 0; i < mat.RowsNumber(); ++i) {
+    for (size_t j = 0; j < mat.ColumnsNumber(); ++j) {
+      os << mat(i, j);
+      if (j != mat.ColumnsNumber() - 1) {
+        os << ' ';
+      }
+    }
+    os << '\n';
+  }
+  return os;
+}
+
+template <typename T>
+LuDecomposition<T> MakeLuDecomposition(const DynMatrix<T>& mat) {
+  if (mat.RowsNumber() != mat.ColumnsNumber()) {
+    throw MatrixSizeMismatch{};
+  }
+  return LuDecomposition<T>(mat.Data(), mat.RowsNumber());
+}
+
+template <typename T>
+T Determinant(const DynMatrix<T>& mat) {
+  if constexpr (std::is_integral_v<T>) {
+    if (mat.RowsNumber() != mat.ColumnsNumber()) {
+      throw MatrixSizeMismatch{};
+    }
+    return BareissDeterminant(mat.Data(), mat.RowsNumber());
+  } else {
+    return MakeLuDecomposition(mat).Determinant();
+  }
+}
+
+template <typename T>
+DynMatrix<T> GetInversed(const DynMatrix<T>& mat) {
+  auto lu = MakeLuDecomposition(mat);
+  DynMatrix<T> res(mat.RowsNumber(), mat.RowsNumber());
+  for (size_t i = 0; i < mat.RowsNumber(); ++i) {
+    res(i, i) = T(1);
+  }
+  lu.Solve(res.Data(), res.ColumnsNumber());
+  return res;
+}
+
+template <typename T>
+DynMatrix<T> Solve(const LuDecomposition<T>& lu, DynMatrix<T> b) {
+  if (b.RowsNumber() != lu.Size()) {
+    throw MatrixSizeMismatch{};
+  }
+  lu.Solve(b.Data(), b.ColumnsNumber());
+  return b;
+}
+
+template <typename T>
+DynMatrix<T> Solve(const DynMatrix<T>& mat, DynMatrix<T> b) {
+  return Solve(MakeLuDecomposition(mat), std::move(b));
+}
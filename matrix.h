@@ -1,6 +1,14 @@
 #pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
 
 class MatrixIsDegenerateError : public std::runtime_error {
  public:
@@ -14,11 +22,181 @@ class MatrixOutOfRange : public std::out_of_range {
   }
 };
 
+class MatrixSizeMismatch : public std::invalid_argument {
+ public:
+  MatrixSizeMismatch() : std::invalid_argument("MatrixSizeMismatch") {
+  }
+};
+
+const size_t kMultiplyTileInner = 256;
+const size_t kMultiplyTileColumns = 512;
+
+// микроядро: блок res 4 x W держится в регистрах весь проход по k, на каждом шаге
+// четыре элемента lhs умножаются на W подряд идущих элементов строки rhs. Цикл по j
+// полностью разворачивается и векторизуется компилятором
+template <typename T, size_t W>
+void MultiplyMicroKernel(size_t depth, const T* lhs, size_t lhs_stride, const T* rhs, size_t rhs_stride, T* res,
+                         size_t res_stride) {
+  T acc[4][W]{};
+  for (size_t k = 0; k < depth; ++k) {
+    const T* row = rhs + k * rhs_stride;
+    for (size_t r = 0; r < 4; ++r) {
+      T factor = lhs[r * lhs_stride + k];
+      for (size_t j = 0; j < W; ++j) {
+        acc[r][j] += factor * row[j];
+      }
+    }
+  }
+  for (size_t r = 0; r < 4; ++r) {
+    for (size_t j = 0; j < W; ++j) {
+      res[r * res_stride + j] += acc[r][j];
+    }
+  }
+}
+
+// res += lhs * rhs для матриц rows x inner и inner x columns, лежащих по строкам с шагами
+// *_stride. Плитка rhs kMultiplyTileInner x kMultiplyTileColumns остаётся в L2, пока по ней
+// проходят все строки lhs; внутри плитки работает микроядро (64 байта строки res на
+// четыре строки), края считаются обычным циклом в порядке i-k-j
+template <typename T>
+void MultiplyAdd(size_t rows, size_t inner, size_t columns, const T* lhs, size_t lhs_stride, const T* rhs,
+                 size_t rhs_stride, T* res, size_t res_stride) {
+  constexpr size_t kWidth = std::max<size_t>(64 / sizeof(T), 1);
+  for (size_t k_begin = 0; k_begin < inner; k_begin += kMultiplyTileInner) {
+    size_t depth = std::min(inner - k_begin, kMultiplyTileInner);
+    const T* rhs_tile = rhs + k_begin * rhs_stride;
+    for (size_t j_begin = 0; j_begin < columns; j_begin += kMultiplyTileColumns) {
+      size_t j_end = std::min(columns, j_begin + kMultiplyTileColumns);
+      for (size_t i = 0; i < rows; i += 4) {
+        size_t height = std::min<size_t>(rows - i, 4);
+        const T* lhs_block = lhs + i * lhs_stride + k_begin;
+        T* res_block = res + i * res_stride;
+        size_t j = j_begin;
+        if (height == 4) {
+          for (; j + kWidth <= j_end; j += kWidth) {
+            MultiplyMicroKernel<T, kWidth>(depth, lhs_block, lhs_stride, rhs_tile + j, rhs_stride, res_block + j,
+                                           res_stride);
+          }
+        }
+        for (size_t r = 0; r < height; ++r) {
+          for (size_t k = 0; k < depth; ++k) {
+            T factor = lhs_block[r * lhs_stride + k];
+            for (size_t tail = j; tail < j_end; ++tail) {
+              res_block[r * res_stride + tail] += factor * rhs_tile[k * rhs_stride + tail];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// пул для операций над матрицами: по умолчанию его нет, и всё считается в текущем потоке.
+// Операции меньше threshold скалярных действий (сложений, умножений-сложений) и с пулом
+// идут последовательно — на них раздача задач дороже самой работы
+struct MatrixParallelism {
+  inline static ThreadPool* pool = nullptr;
+  inline static size_t threshold = 1 << 18;
+};
+
+inline void SetMatrixThreadPool(ThreadPool* pool, size_t threshold = 1 << 18) {
+  MatrixParallelism::pool = pool;
+  MatrixParallelism::threshold = threshold;
+}
+
+// nullptr — считать последовательно; пустая работа всегда последовательна, в том числе
+// при нулевом пороге, иначе разбиение на плитки делит на ноль
+inline ThreadPool* MatrixPoolFor(size_t work) {
+  ThreadPool* pool = MatrixParallelism::pool;
+  if (pool == nullptr || pool->Size() == 0 || work == 0 || work < MatrixParallelism::threshold) {
+    return nullptr;
+  }
+  return pool;
+}
+
+// f(from, to) по блокам строк [0, rows), примерно по четыре блока на поток пула
+template <class F>
+void ForRowBlocks(size_t rows, size_t work, F&& f) {
+  ThreadPool* pool = MatrixPoolFor(work);
+  if (pool == nullptr) {
+    f(size_t{0}, rows);
+    return;
+  }
+  size_t tasks = 4 * pool->Size();
+  ParallelFor(*pool, 0, rows, (rows + tasks - 1) / tasks, f);
+}
+
+// MultiplyAdd, разрезанный по плиткам результата: полосы строк (кратные четырём, чтобы
+// не дробить микроядро) на полосы столбцов ширины kMultiplyTileColumns. Плитки не
+// пересекаются, поэтому потоки пишут в res без синхронизации
+template <typename T>
+void ParallelMultiplyAdd(size_t rows, size_t inner, size_t columns, const T* lhs, size_t lhs_stride, const T* rhs,
+                         size_t rhs_stride, T* res, size_t res_stride) {
+  ThreadPool* pool = MatrixPoolFor(rows * inner * columns);
+  if (pool == nullptr) {
+    MultiplyAdd(rows, inner, columns, lhs, lhs_stride, rhs, rhs_stride, res, res_stride);
+    return;
+  }
+  size_t column_tiles = (columns + kMultiplyTileColumns - 1) / kMultiplyTileColumns;
+  size_t row_tiles = std::max<size_t>(1, 4 * pool->Size() / column_tiles);
+  size_t row_tile = ((rows + row_tiles - 1) / row_tiles + 3) / 4 * 4;
+  row_tiles = (rows + row_tile - 1) / row_tile;
+  ParallelFor(*pool, 0, row_tiles * column_tiles, 1, [&](size_t from, size_t to) {
+    for (size_t tile = from; tile < to; ++tile) {
+      size_t i = tile / column_tiles * row_tile;
+      size_t j = tile % column_tiles * kMultiplyTileColumns;
+      MultiplyAdd(std::min(row_tile, rows - i), inner, std::min(kMultiplyTileColumns, columns - j),
+                  lhs + i * lhs_stride, lhs_stride, rhs + j, rhs_stride, res + i * res_stride + j, res_stride);
+    }
+  });
+}
+
+template <typename T, size_t R, size_t C>
+class Matrix;
+
+// выражение над матрицами: Matrix или ленивый узел ниже. У выражения есть ValueType,
+// kRows, kColumns и operator()(i, j); узлы не вычисляются, пока результат не
+// присвоят в Matrix, и тогда вся цепочка поэлементных операций идёт одним проходом
+template <class E>
+struct IsMatrixExpression : std::false_type {};
+
+template <class E>
+struct IsMatrix : std::false_type {};
+
+template <typename T, size_t R, size_t C>
+struct IsMatrix<Matrix<T, R, C>> : std::true_type {};
+
+template <class E>
+using EnableIfMatrixExpression = std::enable_if_t<IsMatrixExpression<E>::value, int>;
+
+template <class E>
+using EnableIfScalar = std::enable_if_t<!IsMatrixExpression<E>::value, int>;
+
+template <class E>
+using EvaluatedMatrix = Matrix<typename E::ValueType, E::kRows, E::kColumns>;
+
 template <typename T, size_t R, size_t C>
 class Matrix {
  public:
+  using ValueType = T;
+  static constexpr size_t kRows = R;
+  static constexpr size_t kColumns = C;
+
   T arr[R][C];
 
+  template <class E, EnableIfMatrixExpression<E> = 0>
+  Matrix& operator=(const E& expr) {
+    static_assert(E::kRows == R && E::kColumns == C, "matrix sizes differ");
+    ForRowBlocks(R, R * C, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i) {
+        for (size_t j = 0; j < C; ++j) {
+          arr[i][j] = expr(i, j);
+        }
+      }
+    });
+    return *this;
+  }
+
   size_t RowsNumber() const {
     return R;
   }
@@ -49,128 +227,278 @@ class Matrix {
     return arr[i][j];
   }
 
-  Matrix& operator+=(const Matrix<T, R, C>& other) {
-    for (size_t i = 0; i < R; ++i) {
-      for (size_t j = 0; j < C; ++j) {
-        arr[i][j] += other(i, j);
+  template <class E, EnableIfMatrixExpression<E> = 0>
+  Matrix& operator+=(const E& other) {
+    static_assert(E::kRows == R && E::kColumns == C, "matrix sizes differ");
+    ForRowBlocks(R, R * C, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i) {
+        for (size_t j = 0; j < C; ++j) {
+          arr[i][j] += other(i, j);
+        }
       }
-    }
+    });
     return *this;
   }
 
-  Matrix& operator-=(const Matrix<T, R, C>& other) {
-    for (size_t i = 0; i < R; ++i) {
-      for (size_t j = 0; j < C; ++j) {
-        arr[i][j] -= other(i, j);
+  template <class E, EnableIfMatrixExpression<E> = 0>
+  Matrix& operator-=(const E& other) {
+    static_assert(E::kRows == R && E::kColumns == C, "matrix sizes differ");
+    ForRowBlocks(R, R * C, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i) {
+        for (size_t j = 0; j < C; ++j) {
+          arr[i][j] -= other(i, j);
+        }
       }
-    }
+    });
     return *this;
   }
 
-  Matrix& operator*=(const Matrix<T, C, C>& other) {
-    for (size_t i = 0; i < R; ++i) {
-      T temp[C]{};
-      std::swap(temp, arr[i]);
-      for (size_t j = 0; j < C; ++j) {
-        for (size_t k = 0; k < C; ++k) {
-          arr[i][j] += temp[k] * other(k, j);
+  Matrix& operator*=(const Matrix<T, C, C>& other) {  // по блокам строк, копия только блока
+    ForRowBlocks(R, R * C * C, [&](size_t from, size_t to) {
+      const size_t block = std::min<size_t>(to - from, 64);
+      std::vector<T> temp(block * C);
+      for (size_t i = from; i < to; i += block) {
+        size_t rows = std::min(to - i, block);
+        for (size_t r = 0; r < rows; ++r) {
+          std::copy(arr[i + r], arr[i + r] + C, temp.begin() + r * C);
+          std::fill(arr[i + r], arr[i + r] + C, T{});
         }
+        MultiplyAdd(rows, C, C, temp.data(), C, &other.arr[0][0], C, arr[i], C);
       }
-    }
+    });
     return *this;
   }
 
-  template <typename U>
+  template <class E, EnableIfMatrixExpression<E> = 0, std::enable_if_t<!IsMatrix<E>::value, int> = 0>
+  Matrix& operator*=(const E& other) {
+    return *this *= Matrix<T, C, C>(other);
+  }
+
+  template <typename U, EnableIfScalar<U> = 0>
   Matrix& operator*=(const U& num) {
-    for (size_t i = 0; i < R; ++i) {
-      for (size_t j = 0; j < C; ++j) {
-        arr[i][j] *= num;
+    ForRowBlocks(R, R * C, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i) {
+        for (size_t j = 0; j < C; ++j) {
+          arr[i][j] *= num;
+        }
       }
-    }
+    });
     return *this;
   }
 
-  template <typename U>
+  template <typename U, EnableIfScalar<U> = 0>
   Matrix& operator/=(const U& num) {
-    for (size_t i = 0; i < R; ++i) {
-      for (size_t j = 0; j < C; ++j) {
-        arr[i][j] /= num;
+    ForRowBlocks(R, R * C, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i) {
+        for (size_t j = 0; j < C; ++j) {
+          arr[i][j] /= num;
+        }
       }
-    }
+    });
     return *this;
   }
 };
 
 template <typename T, size_t R, size_t C>
-Matrix<T, C, R> GetTransposed(const Matrix<T, R, C>& mat) {
-  Matrix<T, C, R> transposed;
-  for (size_t i = 0; i < R; ++i) {
-    for (size_t j = 0; j < C; ++j) {
-      transposed(j, i) = mat(i, j);
-    }
+struct IsMatrixExpression<Matrix<T, R, C>> : std::true_type {};
+
+// операнд узла: именованная матрица хранится по ссылке, временная (например, результат
+// произведения) и вложенные узлы — по значению, поэтому auto e = a * b + c не висит.
+// Само выражение всё же ссылается на именованные матрицы и не должно их пережить
+template <class E>
+using MatrixOperand = std::conditional_t<std::is_lvalue_reference_v<E> && IsMatrix<std::decay_t<E>>::value,
+                                         const std::decay_t<E>&, std::decay_t<E>>;
+
+// Lhs, Rhs — типы хранения из MatrixOperand
+template <class Lhs, class Rhs, class Op>
+class MatrixBinaryExpression {
+ private:
+  using L = std::decay_t<Lhs>;
+  using R = std::decay_t<Rhs>;
+
+  Lhs lhs_;
+  Rhs rhs_;
+
+ public:
+  using ValueType = typename L::ValueType;
+  static constexpr size_t kRows = L::kRows;
+  static constexpr size_t kColumns = L::kColumns;
+
+  template <class LhsArg, class RhsArg>
+  MatrixBinaryExpression(LhsArg&& lhs, RhsArg&& rhs) : lhs_(std::forward<LhsArg>(lhs)), rhs_(std::forward<RhsArg>(rhs)) {
+    static_assert(L::kRows == R::kRows && L::kColumns == R::kColumns, "matrix sizes differ");
   }
-  return transposed;
-}
 
-template <typename T, size_t R, size_t C>
-Matrix<T, R, C> operator+(const Matrix<T, R, C>& lhs, const Matrix<T, R, C>& rhs) {
-  Matrix<T, R, C> res = lhs;
-  res += rhs;
-  return res;
+  size_t RowsNumber() const {
+    return kRows;
+  }
+
+  size_t ColumnsNumber() const {
+    return kColumns;
+  }
+
+  ValueType operator()(size_t i, size_t j) const {
+    return Op::template Apply<ValueType>(lhs_(i, j), rhs_(i, j));
+  }
+
+  operator Matrix<ValueType, kRows, kColumns>() const {  // NOLINT
+    Matrix<ValueType, kRows, kColumns> res;
+    res = *this;
+    return res;
+  }
+};
+
+template <class E, typename U, class Op>
+class MatrixScalarExpression {
+ private:
+  E mat_;
+  U num_;
+
+ public:
+  using ValueType = typename std::decay_t<E>::ValueType;
+  static constexpr size_t kRows = std::decay_t<E>::kRows;
+  static constexpr size_t kColumns = std::decay_t<E>::kColumns;
+
+  template <class Arg>
+  MatrixScalarExpression(Arg&& mat, const U& num) : mat_(std::forward<Arg>(mat)), num_(num) {
+  }
+
+  size_t RowsNumber() const {
+    return kRows;
+  }
+
+  size_t ColumnsNumber() const {
+    return kColumns;
+  }
+
+  ValueType operator()(size_t i, size_t j) const {
+    return Op::template Apply<ValueType>(mat_(i, j), num_);
+  }
+
+  operator Matrix<ValueType, kRows, kColumns>() const {  // NOLINT
+    Matrix<ValueType, kRows, kColumns> res;
+    res = *this;
+    return res;
+  }
+};
+
+template <class Lhs, class Rhs, class Op>
+struct IsMatrixExpression<MatrixBinaryExpression<Lhs, Rhs, Op>> : std::true_type {};
+
+template <class E, typename U, class Op>
+struct IsMatrixExpression<MatrixScalarExpression<E, U, Op>> : std::true_type {};
+
+// операции через составное присваивание над копией элемента, как и раньше у
+// res = mat; res *= num: тип результата — тип элемента левой матрицы
+struct MatrixAdd {
+  template <typename T, typename L, typename R>
+  static T Apply(const L& lhs, const R& rhs) {
+    T res = lhs;
+    res += rhs;
+    return res;
+  }
+};
+
+struct MatrixSubtract {
+  template <typename T, typename L, typename R>
+  static T Apply(const L& lhs, const R& rhs) {
+    T res = lhs;
+    res -= rhs;
+    return res;
+  }
+};
+
+struct MatrixMultiplyByScalar {
+  template <typename T, typename L, typename R>
+  static T Apply(const L& lhs, const R& rhs) {
+    T res = lhs;
+    res *= rhs;
+    return res;
+  }
+};
+
+struct MatrixDivideByScalar {
+  template <typename T, typename L, typename R>
+  static T Apply(const L& lhs, const R& rhs) {
+    T res = lhs;
+    res /= rhs;
+    return res;
+  }
+};
+
+// произведение не поэлементное, его операнды вычисляются в Matrix заранее
+template <class E>
+const E& Evaluate(const E& mat, std::enable_if_t<IsMatrix<E>::value, int> = 0) {
+  return mat;
 }
 
-template <typename T, size_t R, size_t C>
-Matrix<T, R, C> operator-(const Matrix<T, R, C>& lhs, const Matrix<T, R, C>& rhs) {
-  Matrix<T, R, C> res = lhs;
-  res -= rhs;
-  return res;
+template <class E>
+EvaluatedMatrix<E> Evaluate(const E& expr, std::enable_if_t<!IsMatrix<E>::value, int> = 0) {
+  return expr;
 }
 
-template <typename T, size_t R, size_t C, size_t A>
-Matrix<T, R, A> operator*(const Matrix<T, R, C>& lhs, const Matrix<T, C, A>& rhs) {
-  Matrix<T, R, A> res{};
-  for (size_t i = 0; i < R; ++i) {
-    for (size_t j = 0; j < A; ++j) {
-      for (size_t k = 0; k < C; ++k) {
-        res(i, j) += lhs(i, k) * rhs(k, j);
+template <class E, EnableIfMatrixExpression<E> = 0>
+Matrix<typename E::ValueType, E::kColumns, E::kRows> GetTransposed(const E& mat) {
+  Matrix<typename E::ValueType, E::kColumns, E::kRows> transposed;
+  ForRowBlocks(E::kRows, E::kRows * E::kColumns, [&](size_t from, size_t to) {
+    for (size_t i = from; i < to; ++i) {
+      for (size_t j = 0; j < E::kColumns; ++j) {
+        transposed(j, i) = mat(i, j);
       }
     }
-  }
-  return res;
+  });
+  return transposed;
 }
 
-template <typename T, size_t R, size_t C, typename U>
-Matrix<T, R, C> operator*(const Matrix<T, R, C>& mat, const U& num) {
-  Matrix<T, R, C> res = mat;
-  res *= num;
-  return res;
+template <class Lhs, class Rhs, EnableIfMatrixExpression<std::decay_t<Lhs>> = 0,
+          EnableIfMatrixExpression<std::decay_t<Rhs>> = 0>
+MatrixBinaryExpression<MatrixOperand<Lhs>, MatrixOperand<Rhs>, MatrixAdd> operator+(Lhs&& lhs, Rhs&& rhs) {
+  return {std::forward<Lhs>(lhs), std::forward<Rhs>(rhs)};
 }
 
-template <typename T, size_t R, size_t C, typename U>
-Matrix<T, R, C> operator*(const U& num, const Matrix<T, R, C>& mat) {
-  Matrix<T, R, C> res = mat;
-  res *= num;
-  return res;
+template <class Lhs, class Rhs, EnableIfMatrixExpression<std::decay_t<Lhs>> = 0,
+          EnableIfMatrixExpression<std::decay_t<Rhs>> = 0>
+MatrixBinaryExpression<MatrixOperand<Lhs>, MatrixOperand<Rhs>, MatrixSubtract> operator-(Lhs&& lhs, Rhs&& rhs) {
+  return {std::forward<Lhs>(lhs), std::forward<Rhs>(rhs)};
 }
 
-template <typename T, size_t R, size_t C, typename U>
-Matrix<T, R, C> operator/(const Matrix<T, R, C>& mat, const U& num) {
-  Matrix<T, R, C> res = mat;
-  res /= num;
+template <class Lhs, class Rhs, EnableIfMatrixExpression<Lhs> = 0, EnableIfMatrixExpression<Rhs> = 0>
+Matrix<typename Lhs::ValueType, Lhs::kRows, Rhs::kColumns> operator*(const Lhs& lhs, const Rhs& rhs) {
+  static_assert(Lhs::kColumns == Rhs::kRows, "matrix sizes do not match for multiplication");
+  static_assert(std::is_same_v<typename Lhs::ValueType, typename Rhs::ValueType>, "matrix types differ");
+  const auto& left = Evaluate(lhs);
+  const auto& right = Evaluate(rhs);
+  Matrix<typename Lhs::ValueType, Lhs::kRows, Rhs::kColumns> res{};
+  ParallelMultiplyAdd(Lhs::kRows, Lhs::kColumns, Rhs::kColumns, &left.arr[0][0], Lhs::kColumns, &right.arr[0][0],
+                      Rhs::kColumns, &res.arr[0][0], Rhs::kColumns);
   return res;
 }
 
-template <typename T, size_t R, size_t C, typename U>
-Matrix<T, R, C> operator/(const U& num, const Matrix<T, R, C>& mat) {
-  Matrix<T, R, C> res = mat;
-  res /= num;
-  return res;
+template <class E, typename U, EnableIfMatrixExpression<std::decay_t<E>> = 0, EnableIfScalar<U> = 0>
+MatrixScalarExpression<MatrixOperand<E>, U, MatrixMultiplyByScalar> operator*(E&& mat, const U& num) {
+  return {std::forward<E>(mat), num};
 }
 
-template <typename T, size_t R, size_t C>
-bool operator==(const Matrix<T, R, C>& lhs, const Matrix<T, R, C>& rhs) {
-  for (size_t i = 0; i < R; ++i) {
-    for (size_t j = 0; j < C; ++j) {
+template <class E, typename U, EnableIfMatrixExpression<std::decay_t<E>> = 0, EnableIfScalar<U> = 0>
+MatrixScalarExpression<MatrixOperand<E>, U, MatrixMultiplyByScalar> operator*(const U& num, E&& mat) {
+  return {std::forward<E>(mat), num};
+}
+
+template <class E, typename U, EnableIfMatrixExpression<std::decay_t<E>> = 0, EnableIfScalar<U> = 0>
+MatrixScalarExpression<MatrixOperand<E>, U, MatrixDivideByScalar> operator/(E&& mat, const U& num) {
+  return {std::forward<E>(mat), num};
+}
+
+template <class E, typename U, EnableIfMatrixExpression<std::decay_t<E>> = 0, EnableIfScalar<U> = 0>
+MatrixScalarExpression<MatrixOperand<E>, U, MatrixDivideByScalar> operator/(const U& num, E&& mat) {
+  return {std::forward<E>(mat), num};
+}
+
+template <class Lhs, class Rhs, EnableIfMatrixExpression<Lhs> = 0, EnableIfMatrixExpression<Rhs> = 0>
+bool operator==(const Lhs& lhs, const Rhs& rhs) {
+  static_assert(Lhs::kRows == Rhs::kRows && Lhs::kColumns == Rhs::kColumns, "matrix sizes differ");
+  for (size_t i = 0; i < Lhs::kRows; ++i) {
+    for (size_t j = 0; j < Lhs::kColumns; ++j) {
       if (lhs(i, j) != rhs(i, j)) {
         return false;
       }
@@ -179,8 +507,8 @@ bool operator==(const Matrix<T, R, C>& lhs, const Matrix<T, R, C>& rhs) {
   return true;
 }
 
-template <typename T, size_t R, size_t C>
-bool operator!=(const Matrix<T, R, C>& lhs, const Matrix<T, R, C>& rhs) {
+template <class Lhs, class Rhs, EnableIfMatrixExpression<Lhs> = 0, EnableIfMatrixExpression<Rhs> = 0>
+bool operator!=(const Lhs& lhs, const Rhs& rhs) {
   return !(lhs == rhs);
 }
 
@@ -194,16 +522,255 @@ std::istream& operator>>(std::istream& is, Matrix<T, R, C>& mat) {
   return is;
 }
 
-template <typename T, size_t R, size_t C>
-std::ostream& operator<<(std::ostream& os, const Matrix<T, R, C>& mat) {
-  for (size_t i = 0; i < R; ++i) {
-    for (size_t j = 0; j < C; ++j) {
+template <class E, EnableIfMatrixExpression<E> = 0>
+std::ostream& operator<<(std::ostream& os, const E& mat) {
+  for (size_t i = 0; i < E::kRows; ++i) {
+    for (size_t j = 0; j < E::kColumns; ++j) {
       os << mat(i, j);
-      if (j != C - 1) {
+      if (j != E::kColumns - 1) {
         os << ' ';
       }
     }
     os << '\n';
   }
   return os;
-}
\ No newline at end of file
+}
+
+// определитель целочисленной матрицы n x n (по строкам) методом Барейса: все деления
+// точные, а элементы по ходу вычисления — миноры исходной матрицы. Шаг перемножает два
+// таких минора до деления, поэтому считается в типе вдвое шире T (int64_t для типов до
+// 32 бит, __int128 для 64-битных). Результат точен, пока все эти миноры (в том числе сам
+// определитель) помещаются в T
+template <typename T>
+T BareissDeterminant(const T* data, size_t n) {
+  using Wide = std::conditional_t<(sizeof(T) <= 4), int64_t, __int128>;
+  if (n == 0) {
+    return T(1);
+  }
+  std::vector<Wide> a(data, data + n * n);
+  bool negate = false;
+  Wide previous = 1;
+  for (size_t k = 0; k + 1 < n; ++k) {
+    if (a[k * n + k] == 0) {
+      size_t pivot = k + 1;
+      while (pivot < n && a[pivot * n + k] == 0) {
+        ++pivot;
+      }
+      if (pivot == n) {
+        return T{};
+      }
+      std::swap_ranges(a.begin() + k * n, a.begin() + (k + 1) * n, a.begin() + pivot * n);
+      negate = !negate;
+    }
+    for (size_t i = k + 1; i < n; ++i) {
+      for (size_t j = k + 1; j < n; ++j) {
+        a[i * n + j] = (a[i * n + j] * a[k * n + k] - a[i * n + k] * a[k * n + j]) / previous;
+      }
+    }
+    previous = a[k * n + k];
+  }
+  return static_cast<T>(negate ? -a[n * n - 1] : a[n * n - 1]);
+}
+
+// PA = LU с выбором главного элемента по столбцу: L (единичная диагональ, не хранится)
+// и U лежат на месте исходной матрицы, P — перестановка строк. Матрица режется на
+// вертикальные панели по kLuBlock столбцов: панель раскладывается обычным способом,
+// строка U справа от неё получается прямой подстановкой, а остаток матрицы обновляется
+// одним произведением L21 * U12 через ядро умножения (и через пул, если он задан).
+// Разложение делается один раз, дальше Solve для любого числа правых частей за O(n^2)
+template <typename T>
+class LuDecomposition {
+ private:
+  static_assert(!std::is_integral_v<T>, "LuDecomposition divides by pivots; use a floating-point or rational type");
+
+  static const size_t kLuBlock = 64;
+
+  size_t n_ = 0;
+  std::vector<T> lu_;
+  std::vector<size_t> permutation_;  // строка i разложения — строка permutation_[i] исходной
+  bool odd_ = false;                 // нечётная ли перестановка
+  bool degenerate_ = false;
+
+  static T Magnitude(const T& x) {
+    return x < T{} ? -x : x;
+  }
+
+  T& At(size_t i, size_t j) {
+    return lu_[i * n_ + j];
+  }
+
+  void SwapRows(size_t i, size_t j) {
+    std::swap_ranges(lu_.begin() + i * n_, lu_.begin() + (i + 1) * n_, lu_.begin() + j * n_);
+    std::swap(permutation_[i], permutation_[j]);
+    odd_ = !odd_;
+  }
+
+  void FactorPanel(size_t begin, size_t end) {
+    for (size_t j = begin; j < end; ++j) {
+      size_t pivot = j;
+      for (size_t i = j + 1; i < n_; ++i) {
+        if (Magnitude(At(pivot, j)) < Magnitude(At(i, j))) {
+          pivot = i;
+        }
+      }
+      if (pivot != j) {
+        SwapRows(pivot, j);
+      }
+      if (At(j, j) == T{}) {  // столбец уже нулевой ниже диагонали
+        degenerate_ = true;
+        continue;
+      }
+      for (size_t i = j + 1; i < n_; ++i) {
+        At(i, j) /= At(j, j);
+        T factor = At(i, j);
+        for (size_t c = j + 1; c < end; ++c) {
+          At(i, c) -= factor * At(j, c);
+        }
+      }
+    }
+  }
+
+  void Factor() {
+    permutation_.resize(n_);
+    for (size_t i = 0; i < n_; ++i) {
+      permutation_[i] = i;
+    }
+    std::vector<T> panel;
+    for (size_t begin = 0; begin < n_; begin += kLuBlock) {
+      size_t end = std::min(n_, begin + kLuBlock);
+      FactorPanel(begin, end);
+      if (end == n_) {
+        break;
+      }
+      // U12 = L11^-1 * A12
+      for (size_t j = begin; j < end; ++j) {
+        for (size_t i = j + 1; i < end; ++i) {
+          T factor = At(i, j);
+          for (size_t c = end; c < n_; ++c) {
+            At(i, c) -= factor * At(j, c);
+          }
+        }
+      }
+      // A22 -= L21 * U12: ядро только прибавляет, поэтому L21 копируется с обратным знаком
+      size_t width = end - begin;
+      size_t rest = n_ - end;
+      panel.resize(rest * width);
+      for (size_t i = 0; i < rest; ++i) {
+        for (size_t j = 0; j < width; ++j) {
+          panel[i * width + j] = -At(end + i, begin + j);
+        }
+      }
+      ParallelMultiplyAdd(rest, width, rest, panel.data(), width, &At(begin, end), n_, &At(end, end), n_);
+    }
+  }
+
+ public:
+  LuDecomposition(const T* data, size_t n) : n_(n), lu_(data, data + n * n) {  // n x n по строкам
+    Factor();
+  }
+
+  template <size_t N>
+  explicit LuDecomposition(const Matrix<T, N, N>& mat) : LuDecomposition(&mat.arr[0][0], N) {
+  }
+
+  size_t Size() const {
+    return n_;
+  }
+
+  // вырождена ли матрица точно: есть нулевой главный элемент. Только в этом случае Solve
+  // и GetInversed бросают MatrixIsDegenerateError
+  bool IsDegenerate() const {
+    return degenerate_;
+  }
+
+  // численная проверка по выбору вызывающего: есть ли главный элемент, не больший
+  // tolerance * max|U_kk| (например, n * eps для плавающей точки). На Solve не влияет
+  bool IsDegenerate(const T& tolerance) const {
+    T max = T{};
+    for (size_t i = 0; i < n_; ++i) {
+      max = std::max(max, Magnitude(lu_[i * n_ + i]));
+    }
+    for (size_t i = 0; i < n_; ++i) {
+      if (!(tolerance * max < Magnitude(lu_[i * n_ + i]))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // произведение главных элементов со знаком перестановки
+  T Determinant() const {
+    T det = odd_ ? -T(1) : T(1);
+    for (size_t i = 0; i < n_; ++i) {
+      det *= lu_[i * n_ + i];
+    }
+    return det;
+  }
+
+  // решает A X = B на месте: b — матрица n x columns по строкам, в ней остаётся X
+  void Solve(T* b, size_t columns) const {
+    if (degenerate_) {
+      throw MatrixIsDegenerateError{};
+    }
+    std::vector<T> permuted(n_ * columns);
+    for (size_t i = 0; i < n_; ++i) {
+      std::copy(b + permutation_[i] * columns, b + (permutation_[i] + 1) * columns, permuted.begin() + i * columns);
+    }
+    std::copy(permuted.begin(), permuted.end(), b);
+    for (size_t i = 0; i < n_; ++i) {  // L Y = P B
+      for (size_t k = 0; k < i; ++k) {
+        T factor = lu_[i * n_ + k];
+        for (size_t c = 0; c < columns; ++c) {
+          b[i * columns + c] -= factor * b[k * columns + c];
+        }
+      }
+    }
+    for (size_t i = n_; i-- > 0;) {  // U X = Y
+      for (size_t k = i + 1; k < n_; ++k) {
+        T factor = lu_[i * n_ + k];
+        for (size_t c = 0; c < columns; ++c) {
+          b[i * columns + c] -= factor * b[k * columns + c];
+        }
+      }
+      for (size_t c = 0; c < columns; ++c) {
+        b[i * columns + c] /= lu_[i * n_ + i];
+      }
+    }
+  }
+
+  template <size_t R, size_t C>
+  Matrix<T, R, C> Solve(const Matrix<T, R, C>& b) const {
+    if (R != n_) {
+      throw MatrixSizeMismatch{};
+    }
+    Matrix<T, R, C> res = b;
+    Solve(&res.arr[0][0], C);
+    return res;
+  }
+};
+
+// для целых типов — точный метод Барейса, GetInversed и Solve для них не компилируются
+template <typename T, size_t N>
+T Determinant(const Matrix<T, N, N>& mat) {
+  if constexpr (std::is_integral_v<T>) {
+    return BareissDeterminant(&mat.arr[0][0], N);
+  } else {
+    return LuDecomposition<T>(mat).Determinant();
+  }
+}
+
+template <typename T, size_t N>
+Matrix<T, N, N> GetInversed(const Matrix<T, N, N>& mat) {
+  LuDecomposition<T> lu(mat);
+  Matrix<T, N, N> res{};
+  for (size_t i = 0; i < N; ++i) {
+    res(i, i) = T(1);
+  }
+  lu.Solve(&res.arr[0][0], N);
+  return res;
+}
+
+template <typename T, size_t N, size_t C>
+Matrix<T, N, C> Solve(const Matrix<T, N, N>& mat, const Matrix<T, N, C>& b) {
+  return LuDecomposition<T>(mat).Solve(b);
+}
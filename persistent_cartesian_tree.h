@@ -0,0 +1,299 @@
+#pragma once
+#include <atomic>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cartesian_tree.h"
+
+// узлы неизменяемы, пока на них есть больше одной ссылки: операции копируют только
+// узлы на пути и разделяют остальные. refs считает ссылки от родителей и корней деревьев;
+// узел может освободиться в любом потоке, поэтому память обычная, без NodePool
+template <class Key, class Value, class Aggregate, class Lazy>
+struct PersistentNode : ResultField<typename Aggregate::Type>, PromiseField<typename Lazy::Type> {
+  using KeyType = Key;
+  using ValueType = Value;
+  using AggregateType = Aggregate;
+  using LazyType = Lazy;
+
+  Key x{};
+  int y = 0;
+  Value value{};
+  int size = 1;
+  Key min_x{};
+  Key max_x{};
+  PersistentNode* left = nullptr;
+  PersistentNode* right = nullptr;
+  std::atomic<int> refs = 1;
+
+  PersistentNode() = default;
+
+  PersistentNode(const PersistentNode& other)
+      : ResultField<typename Aggregate::Type>(other),
+        PromiseField<typename Lazy::Type>(other),
+        x(other.x),
+        y(other.y),
+        value(other.value),
+        size(other.size),
+        min_x(other.min_x),
+        max_x(other.max_x),
+        left(other.left),
+        right(other.right) {
+  }
+};
+
+template <class N>
+N* Acquire(N* node_ptr) {
+  if (node_ptr != nullptr) {
+    node_ptr->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  return node_ptr;
+}
+
+template <class N>
+void Release(N* node_ptr) {
+  std::vector<N*> stack;
+  while (true) {
+    if (node_ptr != nullptr && node_ptr->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      stack.push_back(node_ptr->left);
+      stack.push_back(node_ptr->right);
+      delete node_ptr;
+    }
+    if (stack.empty()) {
+      return;
+    }
+    node_ptr = stack.back();
+    stack.pop_back();
+  }
+}
+
+// забирает ссылку на узел и возвращает узел, которым владеет только вызывающий:
+// сам узел, если других ссылок нет, иначе копию
+template <class N>
+N* Own(N* node_ptr) {
+  if (node_ptr == nullptr || node_ptr->refs.load(std::memory_order_acquire) == 1) {
+    return node_ptr;
+  }
+  auto copy = new N(*node_ptr);
+  Acquire(copy->left);
+  Acquire(copy->right);
+  Release(node_ptr);
+  return copy;
+}
+
+template <class N>
+void PushOwned(N* node_ptr) {
+  using Lazy = typename N::LazyType;
+  if constexpr (!std::is_empty_v<typename Lazy::Type>) {
+    Lazy::ApplyValue(node_ptr->value, node_ptr->promise);
+    if constexpr (!std::is_empty_v<typename N::AggregateType::Type>) {
+      Lazy::template ApplyAggregate<typename N::AggregateType>(node_ptr->result, node_ptr->promise, node_ptr->size);
+    }
+    if (node_ptr->left != nullptr) {
+      node_ptr->left = Own(node_ptr->left);
+      node_ptr->left->promise = Lazy::Compose(node_ptr->left->promise, node_ptr->promise);
+    }
+    if (node_ptr->right != nullptr) {
+      node_ptr->right = Own(node_ptr->right);
+      node_ptr->right->promise = Lazy::Compose(node_ptr->right->promise, node_ptr->promise);
+    }
+    node_ptr->promise = Lazy::Identity();
+  }
+}
+
+// PersistentMerge и PersistentSplit забирают ссылки на аргументы и возвращают свои
+template <class N>
+N* PersistentMerge(N* left_root, N* right_root) {
+  if (left_root == nullptr || right_root == nullptr) {
+    return left_root == nullptr ? right_root : left_root;
+  }
+  if (left_root->y < right_root->y) {
+    left_root = Own(left_root);
+    PushOwned(left_root);
+    left_root->right = PersistentMerge(left_root->right, right_root);
+    FixNode(left_root);
+    return left_root;
+  }
+  right_root = Own(right_root);
+  PushOwned(right_root);
+  right_root->left = PersistentMerge(left_root, right_root->left);
+  FixNode(right_root);
+  return right_root;
+}
+
+template <class N>
+std::tuple<N*, N*> PersistentSplit(N* root, const typename N::KeyType& k, bool inclusive = false) {
+  if (root == nullptr) {
+    return {nullptr, nullptr};
+  }
+  root = Own(root);
+  PushOwned(root);
+  if (inclusive ? !(k < root->x) : root->x < k) {
+    auto[left, right] = PersistentSplit(root->right, k, inclusive);
+    root->right = left;
+    FixNode(root);
+    return {root, right};
+  }
+  auto[left, right] = PersistentSplit(root->left, k, inclusive);
+  root->left = right;
+  FixNode(root);
+  return {left, root};
+}
+
+// копия дерева (снимок) делается за O(1) и дальше живёт независимо: запись в одно
+// дерево не меняет узлов, видимых из другого. Один объект нельзя одновременно менять
+// из нескольких потоков, но разные копии можно использовать в разных потоках
+template <class Key = int, class Value = int, class Aggregate = SumAggregate<int64_t>, class Lazy = AddLazy<int>>
+class PersistentCartesianTree {
+ private:
+  using Node = PersistentNode<Key, Value, Aggregate, Lazy>;
+
+  Node* root_ = nullptr;
+
+ public:
+  PersistentCartesianTree() = default;
+
+  PersistentCartesianTree(const PersistentCartesianTree& other) : root_(Acquire(other.root_)) {
+  }
+
+  PersistentCartesianTree(PersistentCartesianTree&& other) noexcept : root_(std::exchange(other.root_, nullptr)) {
+  }
+
+  PersistentCartesianTree& operator=(const PersistentCartesianTree& other) {
+    if (this != &other) {
+      PersistentCartesianTree(other).Swap(*this);
+    }
+    return *this;
+  }
+
+  PersistentCartesianTree& operator=(PersistentCartesianTree&& other) noexcept {
+    if (this != &other) {
+      PersistentCartesianTree(std::move(other)).Swap(*this);
+    }
+    return *this;
+  }
+
+  void Swap(PersistentCartesianTree& other) {
+    std::swap(root_, other.root_);
+  }
+
+  PersistentCartesianTree Snapshot() const {
+    return *this;
+  }
+
+  template <class Iter>
+  void Build(Iter begin, Iter end) {  // пары (x, y), x строго возрастают
+    Release(std::exchange(root_, nullptr));
+    std::vector<Node*> right_spine;
+    for (; begin != end; ++begin) {
+      auto node_ptr = new Node;
+      node_ptr->x = node_ptr->min_x = node_ptr->max_x = begin->first;
+      node_ptr->y = begin->second;
+      node_ptr->result = Aggregate::Lift(node_ptr->value);
+      node_ptr->promise = Lazy::Identity();
+      Node* last = nullptr;
+      while (!right_spine.empty() && right_spine.back()->y > node_ptr->y) {
+        last = right_spine.back();
+        right_spine.pop_back();
+        FixNode(last);
+      }
+      node_ptr->left = last;
+      if (!right_spine.empty()) {
+        right_spine.back()->right = node_ptr;
+      }
+      right_spine.push_back(node_ptr);
+    }
+    if (!right_spine.empty()) {
+      root_ = right_spine.front();
+    }
+    while (!right_spine.empty()) {
+      FixNode(right_spine.back());
+      right_spine.pop_back();
+    }
+  }
+
+  typename Aggregate::Type Sum(const Key& begin, const Key& end) const {  // не включая end
+    if (root_ == nullptr || !(root_->min_x < end) || root_->max_x < begin) {
+      return Aggregate::Identity();
+    }
+    return ::Sum(static_cast<const Node*>(root_), begin, end);
+  }
+
+  void Add(const Key& begin, const Key& end, const typename Lazy::Type& delta) {  // не включая end
+    static_assert(!std::is_empty_v<typename Lazy::Type>, "Add requires a lazy operation");
+    if (root_ == nullptr || !(root_->min_x < end) || root_->max_x < begin) {
+      return;
+    }
+    auto[begin_left, begin_right] = PersistentSplit(std::exchange(root_, nullptr), begin);
+    auto[sub_root, root_right] = PersistentSplit(begin_right, end);
+    if (sub_root != nullptr) {
+      sub_root = Own(sub_root);
+      sub_root->promise = Lazy::Compose(sub_root->promise, delta);
+    }
+    root_ = PersistentMerge(PersistentMerge(begin_left, sub_root), root_right);
+  }
+
+  void Insert(const Key& k, int y, const Value& value = {}) {
+    if (!IsExist(k)) {
+      auto node_ptr = new Node;
+      node_ptr->x = node_ptr->min_x = node_ptr->max_x = k;
+      node_ptr->y = y;
+      node_ptr->value = value;
+      node_ptr->result = Aggregate::Lift(value);
+      node_ptr->promise = Lazy::Identity();
+      auto[left, right] = PersistentSplit(std::exchange(root_, nullptr), k);
+      root_ = PersistentMerge(PersistentMerge(left, node_ptr), right);
+    }
+  }
+
+  void Erase(const Key& k) {
+    if (IsExist(k)) {
+      auto[less, not_less] = PersistentSplit(std::exchange(root_, nullptr), k);
+      auto[k_ptr, more] = PersistentSplit(not_less, k, true);
+      Release(k_ptr);
+      root_ = PersistentMerge(less, more);
+    }
+  }
+
+  bool IsExist(const Key& key) const {
+    return Find(static_cast<const Node*>(root_), key) != nullptr;
+  }
+
+  std::optional<Key> Next(const Key& key) const {
+    auto next = LowerBound(static_cast<const Node*>(root_), key, true);
+    if (next != nullptr) {
+      return next->x;
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Key> Prev(const Key& key) const {
+    auto prev = NotMore(static_cast<const Node*>(root_), key, true);
+    if (prev != nullptr) {
+      return prev->x;
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Key> KthElement(int k) const {
+    const Node* curr_root = root_;
+    while (curr_root != nullptr) {
+      if (Size(curr_root->left) == k) {
+        return curr_root->x;
+      }
+      if (Size(curr_root->left) < k) {
+        k -= Size(curr_root->left) + 1;
+        curr_root = curr_root->right;
+      } else {
+        curr_root = curr_root->left;
+      }
+    }
+    return std::nullopt;
+  }
+
+  ~PersistentCartesianTree() {
+    Release(root_);
+  }
+};
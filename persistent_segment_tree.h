@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "segment_tree.h"
+
+// все версии дерева в одном массиве узлов: Update копирует только узлы на своих путях
+// (O(log n) узлов) и возвращает номер новой версии, старые версии не меняются и
+// остаются доступными для Query. Метки постоянные — не проталкиваются и не копируются
+// в детей, поэтому нужны коммутирующие обновления
+template <class Monoid = MaxMonoid<int>, class Lazy = RangeAdd<int>>
+class PersistentSegmentTree {
+ private:
+  static_assert(Lazy::kCommutes, "PersistentSegmentTree requires commuting range updates");
+
+  using Value = typename Monoid::Type;
+  using Tag = typename Lazy::Type;
+
+  struct Node : SegmentNode<Value, Tag> {
+    uint32_t left = 0;
+    uint32_t right = 0;
+  };
+
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> roots_;
+  size_t n_;
+
+  uint32_t Build(const std::vector<Value>& v, size_t nl, size_t nr) {
+    Node node;
+    if constexpr (!std::is_empty_v<Tag>) {
+      node.tag = Lazy::Identity();
+    }
+    if (nr - nl == 1) {
+      node.value = nl < v.size() ? v[nl] : Monoid::Identity();
+    } else {
+      size_t mid = nl + (nr - nl) / 2;
+      node.left = Build(v, nl, mid);
+      node.right = Build(v, mid, nr);
+      node.value = Monoid::Combine(nodes_[node.left].value, nodes_[node.right].value);
+    }
+    nodes_.push_back(node);
+    return static_cast<uint32_t>(nodes_.size() - 1);
+  }
+
+  Value Query(uint32_t idx, size_t nl, size_t nr, size_t l, size_t r) const {
+    if (l <= nl && nr <= r) {
+      return nodes_[idx].value;
+    }
+    size_t mid = nl + (nr - nl) / 2;
+    auto res = Monoid::Identity();
+    if (l < mid) {
+      res = Query(nodes_[idx].left, nl, mid, l, r);
+    }
+    if (mid < r) {
+      res = Monoid::Combine(res, Query(nodes_[idx].right, mid, nr, l, r));
+    }
+    Lazy::template Apply<Monoid>(res, nodes_[idx].tag, std::min(nr, r) - std::max(nl, l));
+    return res;
+  }
+
+  uint32_t Update(uint32_t idx, size_t nl, size_t nr, size_t l, size_t r, const Tag& tag) {
+    Node node = nodes_[idx];
+    if (l <= nl && nr <= r) {
+      Lazy::template Apply<Monoid>(node.value, tag, nr - nl);
+      node.tag = Lazy::Compose(node.tag, tag);
+    } else {
+      size_t mid = nl + (nr - nl) / 2;
+      if (l < mid) {
+        node.left = Update(node.left, nl, mid, l, r, tag);
+      }
+      if (mid < r) {
+        node.right = Update(node.right, mid, nr, l, r, tag);
+      }
+      node.value = Monoid::Combine(nodes_[node.left].value, nodes_[node.right].value);
+      Lazy::template Apply<Monoid>(node.value, node.tag, nr - nl);
+    }
+    nodes_.push_back(node);
+    return static_cast<uint32_t>(nodes_.size() - 1);
+  }
+
+ public:
+  explicit PersistentSegmentTree(const std::vector<Value>& v) : n_(std::max<size_t>(v.size(), 1)) {
+    nodes_.reserve(2 * n_);
+    roots_.push_back(Build(v, 0, n_));
+  }
+
+  size_t VersionCount() const {
+    return roots_.size();
+  }
+
+  size_t NodeCount() const {
+    return nodes_.size();
+  }
+
+  Value Query(size_t version, size_t l, size_t r) const {  // включая r
+    return Query(roots_[version], 0, n_, l, r + 1);
+  }
+
+  size_t Update(size_t version, size_t l, size_t r, const Tag& tag) {  // включая r, возвращает новую версию
+    static_assert(!std::is_empty_v<Tag>, "Update requires a range update");
+    roots_.push_back(Update(roots_[version], 0, n_, l, r + 1, tag));
+    return roots_.size() - 1;
+  }
+};
@@ -1,59 +1,396 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
+
+const size_t kBuildGrain = 1 << 16;  // элементов на одну задачу пула при построении
+
+// f(from, to) по кускам: в пуле, если он есть, иначе одним вызовом
+template <class F>
+void BuildFor(ThreadPool* pool, size_t begin, size_t end, size_t grain, F&& f) {
+  if (begin >= end) {
+    return;
+  }
+  if (pool != nullptr) {
+    ParallelFor(*pool, begin, end, grain, f);
+  } else {
+    f(begin, end);
+  }
+}
+
+// prefix_sum[i] — сумма первых i элементов. В пуле: суммы кусков считаются параллельно,
+// сдвиги кусков — последовательно по их итогам, затем куски сдвигаются параллельно
+inline std::vector<int64_t> PrefixSums(const std::vector<int>& v, ThreadPool* pool) {
+  std::vector<int64_t> prefix_sum(v.size() + 1);
+  size_t chunks = (pool != nullptr) ? std::max<size_t>(pool->Size(), 1) * 4 : 1;
+  size_t chunk = std::max((v.size() + chunks - 1) / chunks, kBuildGrain);
+  chunks = (v.size() + chunk - 1) / chunk;
+  BuildFor(pool, 0, chunks, 1, [&](size_t from, size_t to) {
+    for (size_t c = from; c < to; ++c) {
+      int64_t sum = 0;
+      for (size_t i = c * chunk; i < std::min(v.size(), c * chunk + chunk); ++i) {
+        sum += v[i];
+        prefix_sum[i + 1] = sum;
+      }
+    }
+  });
+  std::vector<int64_t> shift(chunks, 0);
+  for (size_t c = 1; c < chunks; ++c) {
+    shift[c] = shift[c - 1] + prefix_sum[c * chunk];
+  }
+  BuildFor(pool, 1, chunks, 1, [&](size_t from, size_t to) {
+    for (size_t c = from; c < to; ++c) {
+      for (size_t i = c * chunk; i < std::min(v.size(), c * chunk + chunk); ++i) {
+        prefix_sum[i + 1] += shift[c];
+      }
+    }
+  });
+  return prefix_sum;
+}
+
+// индексы внутри с единицы: ft_[i] хранит сумму (i - lowbit(i), i], ft_[0] не используется
 class FenwickTree {
  private:
   std::vector<int64_t> ft_;
+  size_t high_bit_ = 1;  // старшая степень двойки не больше размера, для LowerBound
+
+  static size_t LowBit(size_t i) {
+    return i & (~i + 1);
+  }
 
-  int64_t PrefixSum(int idx) {
+  int64_t PrefixSum(size_t count) const {  // сумма первых count элементов
     int64_t sum = 0;
-    for (int i = idx; i >= 0; i = (i & (i + 1)) - 1) {
+    for (size_t i = count; i > 0; i -= LowBit(i)) {
       sum += ft_[i];
     }
     return sum;
   }
 
+  void Build(const std::vector<int> &v, ThreadPool* pool) {
+    auto prefix_sum = PrefixSums(v, pool);
+    ft_.resize(v.size() + 1);
+    BuildFor(pool, 1, v.size() + 1, kBuildGrain, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i) {
+        ft_[i] = prefix_sum[i] - prefix_sum[i - LowBit(i)];
+      }
+    });
+    while (high_bit_ * 2 <= v.size()) {
+      high_bit_ *= 2;
+    }
+  }
+
  public:
   explicit FenwickTree(const std::vector<int> &v) {
-    std::vector<int64_t> prefix_sum(v.size() + 1);
-    prefix_sum[0] = 0;
-    for (size_t i = 1; i <= v.size(); ++i) {
-      prefix_sum[i] = prefix_sum[i - 1] + v[i - 1];
+    Build(v, nullptr);
+  }
+
+  FenwickTree(const std::vector<int> &v, ThreadPool& pool) {
+    Build(v, &pool);
+  }
+
+  void Add(size_t idx, int64_t delta) {
+    for (size_t i = idx + 1; i < ft_.size(); i += LowBit(i)) {
+      ft_[i] += delta;
+    }
+  }
+
+  int64_t Query(int l, int r) const {
+    return PrefixSum(r + 1) - PrefixSum(l);
+  }
+
+  // первый idx, на котором сумма [0, idx] достигает target, или размер, если такого нет;
+  // элементы должны быть неотрицательными
+  size_t LowerBound(int64_t target) const {
+    size_t pos = 0;
+    for (size_t step = high_bit_; step > 0; step >>= 1) {
+      if (pos + step < ft_.size() && ft_[pos + step] < target) {
+        pos += step;
+        target -= ft_[pos];
+      }
     }
-    ft_.resize(v.size());
-    for (size_t i = 0; i < v.size(); ++i) {
-      ft_[i] = prefix_sum[i + 1] - prefix_sum[i & (i + 1)];
+    return pos;
+  }
+};
+
+// FenwickTree, который можно менять из многих потоков без блокировок: каждая ячейка —
+// атомарный счётчик, Add делает fetch_add по своему пути. Гарантии:
+// - Add из разных потоков не теряются, после их завершения дерево точное;
+// - Query видит все Add, которые произошли до него (завершились раньше в том же потоке
+//   или синхронизированы с ним), а из идущих одновременно с ним — любое подмножество;
+// - префикс Query(0, r) учитывает каждый одновременный Add целиком или никак, потому что
+//   читает ровно одну ячейку, покрывающую элемент; при l > 0 одновременный Add левее l может
+//   временно сдвинуть ответ на свою delta — общего снимка всех ячеек нет
+class ConcurrentFenwickTree {
+ private:
+  std::vector<std::atomic<int64_t>> ft_;
+
+  static size_t LowBit(size_t i) {
+    return i & (~i + 1);
+  }
+
+  int64_t PrefixSum(size_t count) const {
+    int64_t sum = 0;
+    for (size_t i = count; i > 0; i -= LowBit(i)) {
+      sum += ft_[i].load(std::memory_order_relaxed);
     }
+    return sum;
+  }
+
+  void Build(const std::vector<int> &v, ThreadPool* pool) {
+    auto prefix_sum = PrefixSums(v, pool);
+    BuildFor(pool, 1, v.size() + 1, kBuildGrain, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i) {
+        ft_[i].store(prefix_sum[i] - prefix_sum[i - LowBit(i)], std::memory_order_relaxed);
+      }
+    });
+  }
+
+ public:
+  explicit ConcurrentFenwickTree(const std::vector<int> &v) : ft_(v.size() + 1) {
+    Build(v, nullptr);
+  }
+
+  ConcurrentFenwickTree(const std::vector<int> &v, ThreadPool& pool) : ft_(v.size() + 1) {
+    Build(v, &pool);
   }
 
   void Add(size_t idx, int64_t delta) {
-    for (size_t i = idx; i < ft_.size(); i = i | (i + 1)) {
-      ft_[i] += delta;
+    for (size_t i = idx + 1; i < ft_.size(); i += LowBit(i)) {
+      ft_[i].fetch_add(delta, std::memory_order_relaxed);
     }
   }
 
-  int64_t Query(int l, int r) {
-    return PrefixSum(r) - PrefixSum(l - 1);
+  int64_t Query(int l, int r) const {
+    return PrefixSum(r + 1) - PrefixSum(l);
   }
 };
 
+// прибавка и сумма на отрезке: сумма первых i элементов равна first(i) * i - second(i),
+// где first и second — два дерева Фенвика; они лежат в одном массиве, чтобы проход
+// по индексам задевал одни и те же строки кэша
+class RangeFenwickTree {
+ private:
+  struct Cell {
+    int64_t first = 0;
+    int64_t second = 0;
+  };
+
+  std::vector<Cell> ft_;
+
+  static size_t LowBit(size_t i) {
+    return i & (~i + 1);
+  }
+
+  void AddSuffix(size_t count, int64_t first, int64_t second) {  // с позиции count (с единицы)
+    for (size_t i = count; i < ft_.size(); i += LowBit(i)) {
+      ft_[i].first += first;
+      ft_[i].second += second;
+    }
+  }
+
+  int64_t PrefixSum(size_t count) const {
+    int64_t first = 0;
+    int64_t second = 0;
+    for (size_t i = count; i > 0; i -= LowBit(i)) {
+      first += ft_[i].first;
+      second += ft_[i].second;
+    }
+    return first * static_cast<int64_t>(count) - second;
+  }
+
+  void Build(const std::vector<int> &v, ThreadPool* pool) {
+    auto prefix_sum = PrefixSums(v, pool);
+    ft_.resize(v.size() + 1);
+    BuildFor(pool, 1, v.size() + 1, kBuildGrain, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i) {
+        ft_[i].second = prefix_sum[i - LowBit(i)] - prefix_sum[i];
+      }
+    });
+  }
+
+ public:
+  explicit RangeFenwickTree(const std::vector<int> &v) {
+    Build(v, nullptr);
+  }
+
+  RangeFenwickTree(const std::vector<int> &v, ThreadPool& pool) {
+    Build(v, &pool);
+  }
+
+  void Add(size_t l, size_t r, int64_t delta) {  // включая r
+    AddSuffix(l + 1, delta, delta * static_cast<int64_t>(l));
+    AddSuffix(r + 2, -delta, -delta * static_cast<int64_t>(r + 1));
+  }
+
+  int64_t Query(size_t l, size_t r) const {  // включая r
+    return PrefixSum(r + 1) - PrefixSum(l);
+  }
+};
+
+// минимум на отрезке за O(1) и O(n) памяти: массив делится на блоки по 64 элемента.
+// Для каждой позиции i хранится маска монотонного стека своего блока после i: бит j стоит,
+// если элемент j меньше всех после него до i. Тогда минимум [l, r] внутри блока — младший
+// бит маски r не левее l. Между блоками — разреженная таблица по минимумам блоков,
+// все её уровни в одном массиве. При равенстве выбирается левый элемент
+template <class T = int, class Compare = std::less<T>>
 class SparseTable {
  private:
-  std::vector<std::vector<int>> table_;
+  static constexpr size_t kBlock = 64;
+
+  std::vector<T> values_;
+  std::vector<uint64_t> masks_;
+  std::vector<uint32_t> table_;  // уровень k занимает [k * blocks_, (k + 1) * blocks_)
+  size_t blocks_ = 0;
+  Compare less_;
+
+  size_t Better(size_t left, size_t right) const {
+    return less_(values_[right], values_[left]) ? right : left;
+  }
+
+  size_t InBlock(size_t l, size_t r) const {  // l и r в одном блоке
+    uint64_t mask = masks_[r] & (~uint64_t{0} << (l % kBlock));
+    return r - r % kBlock + __builtin_ctzll(mask);
+  }
+
+  void Build(ThreadPool* pool) {  // блоки и позиции на каждом уровне независимы
+    size_t n = values_.size();
+    blocks_ = (n + kBlock - 1) / kBlock;
+    masks_.resize(n);
+    BuildFor(pool, 0, blocks_, kBuildGrain / kBlock, [&](size_t from, size_t to) {
+      for (size_t start = from * kBlock; start < std::min(n, to * kBlock); start += kBlock) {
+        uint64_t stack = 0;
+        for (size_t i = start; i < std::min(n, start + kBlock); ++i) {
+          while (stack != 0) {
+            size_t top = 63 - __builtin_clzll(stack);
+            if (!less_(values_[i], values_[start + top])) {
+              break;
+            }
+            stack ^= uint64_t{1} << top;
+          }
+          stack |= uint64_t{1} << (i - start);
+          masks_[i] = stack;
+        }
+      }
+    });
+    if (blocks_ == 0) {
+      return;
+    }
+    size_t levels = std::__lg(blocks_) + 1;
+    table_.resize(levels * blocks_);
+    BuildFor(pool, 0, blocks_, kBuildGrain / kBlock, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i) {
+        table_[i] = static_cast<uint32_t>(InBlock(i * kBlock, std::min(n, i * kBlock + kBlock) - 1));
+      }
+    });
+    for (size_t k = 1; k < levels; ++k) {
+      auto prev = table_.data() + (k - 1) * blocks_;
+      auto curr = table_.data() + k * blocks_;
+      BuildFor(pool, 0, blocks_ + 1 - (size_t{1} << k), kBuildGrain, [&](size_t from, size_t to) {
+        for (size_t i = from; i < to; ++i) {
+          curr[i] = static_cast<uint32_t>(Better(prev[i], prev[i + (size_t{1} << (k - 1))]));
+        }
+      });
+    }
+  }
+
+ public:
+  explicit SparseTable(std::vector<T> v, Compare less = Compare()) : values_(std::move(v)), less_(less) {
+    Build(nullptr);
+  }
+
+  SparseTable(std::vector<T> v, ThreadPool& pool, Compare less = Compare()) : values_(std::move(v)), less_(less) {
+    Build(&pool);
+  }
+
+  size_t ArgMin(size_t l, size_t r) const {  // включая r
+    size_t l_block = l / kBlock;
+    size_t r_block = r / kBlock;
+    if (l_block == r_block) {
+      return InBlock(l, r);
+    }
+    size_t res = InBlock(l, l_block * kBlock + kBlock - 1);
+    if (l_block + 1 < r_block) {
+      size_t k = std::__lg(r_block - l_block - 1);
+      auto level = table_.data() + k * blocks_;
+      res = Better(res, level[l_block + 1]);
+      res = Better(res, level[r_block - (size_t{1} << k)]);
+    }
+    return Better(res, InBlock(r_block * kBlock, r));
+  }
+
+  T Min(size_t l, size_t r) const {  // включая r
+    return values_[ArgMin(l, r)];
+  }
+};
+
+// то же разбиение для любой ассоциативной идемпотентной операции (max, gcd, and, or):
+// в каждом блоке префиксы и суффиксы, между блоками разреженная таблица.
+// Отрезок из разных блоков — O(1), внутри одного блока — проход по нему
+template <class T, class Op>
+class BlockSparseTable {
+ private:
+  static constexpr size_t kBlock = 32;
+
+  std::vector<T> values_;
+  std::vector<T> prefix_;  // от начала блока до i
+  std::vector<T> suffix_;  // от i до конца блока
+  std::vector<T> table_;   // уровень k занимает [k * blocks_, (k + 1) * blocks_)
+  size_t blocks_ = 0;
+  Op op_;
 
  public:
-  explicit SparseTable(const std::vector<int>& v) {
-    size_t n = v.size();
-    size_t log_n = std::__lg(n);
-    table_.resize(log_n + 1);
-    table_[0] = v;
-    for (size_t k = 1; k <= log_n; ++k) {
-      table_[k].resize(n - (1 << k) + 1);
-      for (size_t i = 0; i <= n - (1 << k); ++i) {
-        table_[k][i] = std::min(table_[k - 1][i], table_[k - 1][i + (1 << (k - 1))]);
+  explicit BlockSparseTable(std::vector<T> v, Op op = Op()) : values_(std::move(v)), op_(op) {
+    size_t n = values_.size();
+    prefix_ = values_;
+    suffix_ = values_;
+    for (size_t i = 1; i < n; ++i) {
+      if (i % kBlock != 0) {
+        prefix_[i] = op_(prefix_[i - 1], values_[i]);
+      }
+    }
+    for (size_t i = n; i-- > 0;) {
+      if (i + 1 < n && (i + 1) % kBlock != 0) {
+        suffix_[i] = op_(values_[i], suffix_[i + 1]);
+      }
+    }
+    blocks_ = (n + kBlock - 1) / kBlock;
+    if (blocks_ == 0) {
+      return;
+    }
+    size_t levels = std::__lg(blocks_) + 1;
+    table_.resize(levels * blocks_);
+    for (size_t i = 0; i < blocks_; ++i) {
+      table_[i] = suffix_[i * kBlock];
+    }
+    for (size_t k = 1; k < levels; ++k) {
+      auto prev = table_.data() + (k - 1) * blocks_;
+      auto curr = table_.data() + k * blocks_;
+      for (size_t i = 0; i + (size_t{1} << k) <= blocks_; ++i) {
+        curr[i] = op_(prev[i], prev[i + (size_t{1} << (k - 1))]);
       }
     }
   }
 
-  int Min(size_t l, size_t r) {
-    size_t log_n = std::__lg(r - l + 1);
-    return std::min(table_[log_n][l], table_[log_n][r - (1 << log_n) + 1]);
+  T Query(size_t l, size_t r) const {  // включая r
+    size_t l_block = l / kBlock;
+    size_t r_block = r / kBlock;
+    if (l_block == r_block) {
+      T res = values_[l];
+      for (size_t i = l + 1; i <= r; ++i) {
+        res = op_(res, values_[i]);
+      }
+      return res;
+    }
+    T res = suffix_[l];
+    if (l_block + 1 < r_block) {
+      size_t k = std::__lg(r_block - l_block - 1);
+      auto level = table_.data() + k * blocks_;
+      res = op_(op_(res, level[l_block + 1]), level[r_block - (size_t{1} << k)]);
+    }
+    return op_(res, prefix_[r]);
   }
 };
@@ -1,87 +1,354 @@
-#include <iostream>
-#include <vector>
-#include <algorithm>
-
-const int kNeutral = std::numeric_limits<int>::min();
-
-class SegmentTree {
- private:
-  struct Node {
-    int value = kNeutral;
-    int promise = 0;
-  };
-
-  std::vector<Node> tree_;
-
-  size_t Left(size_t parent) {
-    return 2 * parent + 1;
-  }
-
-  size_t Right(size_t parent) {
-    return 2 * parent + 2;
-  }
-
-  void Push(size_t idx) {
-    if (tree_[idx].value == kNeutral) {
-      tree_[idx].value = 0;
-    }
-    tree_[idx].value += tree_[idx].promise;
-    if (2 * idx + 2 < tree_.size()) {
-      tree_[Left(idx)].promise += tree_[idx].promise;
-      tree_[Right(idx)].promise += tree_[idx].promise;
-    }
-    tree_[idx].promise = 0;
-  }
-
-  int Max(size_t l, size_t r, size_t idx, size_t l_idx, size_t r_idx) {
-    if (idx >= tree_.size() || (l > r_idx || l_idx > r)) {
-      return kNeutral;
-    }
-    if (l <= l_idx && r_idx <= r) {
-      return tree_[idx].value + tree_[idx].promise;
-    }
-    Push(idx);
-    size_t mid_idx = (l_idx + r_idx) / 2;
-    return std::max(Max(l, r, Left(idx), l_idx, mid_idx), Max(l, r, Right(idx), mid_idx + 1, r_idx));
-  }
-
-  void Add(size_t l, size_t r, size_t idx, size_t l_idx, size_t r_idx, int delta) {
-    if (idx >= tree_.size() || (l > r_idx || l_idx > r)) {
-      return;
-    }
-    if (l <= l_idx && r_idx <= r) {
-      tree_[idx].promise += delta;
-      return;
-    }
-    Push(idx);
-    size_t mid_idx = (l_idx + r_idx) / 2;
-    Add(l, r, Left(idx), l_idx, mid_idx, delta);
-    Add(l, r, Right(idx), mid_idx + 1, r_idx, delta);
-    tree_[idx].value = std::max(tree_[Left(idx)].value + tree_[Left(idx)].promise,
-                                tree_[Right(idx)].value + tree_[Right(idx)].promise);
-  }
-
- public:
-  explicit SegmentTree(const std::vector<int> &v) {
-    auto n = static_cast<int>(v.size());
-    size_t log_n = std::__lg(n);
-    if (n != (1 << log_n)) {
-      n = 1 << (log_n + 1);
-    }
-    tree_.resize(2 * n - 1);
-    for (size_t i = 0; i < v.size(); ++i) {
-      tree_[i + n - 1].value = v[i];
-    }
-    for (int i = n - 2; i >= 0; --i) {
-      tree_[i].value = std::max(tree_[Left(i)].value, tree_[Right(i)].value);
-    }
-  }
-
-  int Max(size_t l, size_t r) {
-    return Max(l, r, 0, 0, tree_.size() / 2);
-  }
-
-  void Add(size_t l, size_t r, int delta) {
-    Add(l, r, 0, 0, tree_.size() / 2, delta);
-  }
-};
+#pragma once
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <type_traits>
+
+#include "thread_pool.h"
+
+// Monoid: Identity, Combine(lhs, rhs), kScalesWithLength — растёт ли значение отрезка
+// пропорционально длине при прибавке ко всем элементам, и kDistributesOverAdd — можно ли
+// пересчитать значение отрезка после прибавки ко всем его элементам, не зная самих
+// элементов (для gcd нельзя: gcd(4, 8) + 2 != gcd(6, 10))
+
+template <class T>
+struct MaxMonoid {
+  using Type = T;
+  static const bool kScalesWithLength = false;
+  static const bool kDistributesOverAdd = true;
+
+  static Type Identity() {
+    return std::numeric_limits<T>::lowest();
+  }
+
+  static Type Combine(const Type& lhs, const Type& rhs) {
+    return std::max(lhs, rhs);
+  }
+};
+
+template <class T>
+struct MinMonoid {
+  using Type = T;
+  static const bool kScalesWithLength = false;
+  static const bool kDistributesOverAdd = true;
+
+  static Type Identity() {
+    return std::numeric_limits<T>::max();
+  }
+
+  static Type Combine(const Type& lhs, const Type& rhs) {
+    return std::min(lhs, rhs);
+  }
+};
+
+template <class T>
+struct SumMonoid {
+  using Type = T;
+  static const bool kScalesWithLength = true;
+  static const bool kDistributesOverAdd = true;
+
+  static Type Identity() {
+    return 0;
+  }
+
+  static Type Combine(const Type& lhs, const Type& rhs) {
+    return lhs + rhs;
+  }
+};
+
+template <class T>
+struct GcdMonoid {
+  using Type = T;
+  static const bool kScalesWithLength = false;
+  static const bool kDistributesOverAdd = false;
+
+  static Type Identity() {
+    return 0;
+  }
+
+  static Type Combine(const Type& lhs, const Type& rhs) {
+    return std::gcd(lhs, rhs);
+  }
+};
+
+// RangeUpdate: Identity, Compose(older, newer), Apply<Monoid>(value, tag, length) и kCommutes —
+// можно ли применять метки в любом порядке; тогда обновление не проталкивает метки предков.
+// RangeAdd и RangeAssignAdd подходят только монойдам с kDistributesOverAdd (максимум,
+// минимум, сумма); для gcd нужен NoRangeUpdate: SegmentTree<GcdMonoid<int>, NoRangeUpdate>
+
+template <class T>
+struct RangeAdd {
+  using Type = T;
+  static const bool kCommutes = true;
+
+  static Type Identity() {
+    return 0;
+  }
+
+  static Type Compose(const Type& older, const Type& newer) {
+    return older + newer;
+  }
+
+  template <class Monoid>
+  static void Apply(typename Monoid::Type& value, const Type& tag, size_t length) {
+    static_assert(Monoid::kDistributesOverAdd, "RangeAdd requires a monoid that distributes over addition");
+    if constexpr (Monoid::kScalesWithLength) {
+      value += static_cast<typename Monoid::Type>(tag) * static_cast<typename Monoid::Type>(length);
+    } else if (value != Monoid::Identity()) {  // пустой отрезок остаётся пустым, без переполнения
+      value += tag;
+    }
+  }
+};
+
+// сначала присваивание (если есть), потом прибавка
+template <class T>
+struct RangeAssignAdd {
+  struct Type {
+    std::optional<T> assign;
+    T add = 0;
+  };
+  static const bool kCommutes = false;
+
+  static Type Identity() {
+    return {};
+  }
+
+  static Type Compose(const Type& older, const Type& newer) {
+    if (newer.assign.has_value()) {
+      return newer;
+    }
+    return {older.assign, older.add + newer.add};
+  }
+
+  template <class Monoid>
+  static void Apply(typename Monoid::Type& value, const Type& tag, size_t length) {
+    static_assert(Monoid::kDistributesOverAdd, "RangeAssignAdd requires a monoid that distributes over addition");
+    using V = typename Monoid::Type;
+    if constexpr (Monoid::kScalesWithLength) {
+      if (tag.assign.has_value()) {
+        value = static_cast<V>(*tag.assign) * static_cast<V>(length);
+      }
+      value += static_cast<V>(tag.add) * static_cast<V>(length);
+    } else {
+      if (tag.assign.has_value()) {
+        value = *tag.assign;
+      }
+      if (value != Monoid::Identity()) {
+        value += tag.add;
+      }
+    }
+  }
+};
+
+struct NoRangeUpdate {
+  struct Type {};
+  static const bool kCommutes = true;
+
+  static Type Identity() {
+    return {};
+  }
+
+  static Type Compose(const Type&, const Type&) {
+    return {};
+  }
+
+  template <class Monoid>
+  static void Apply(typename Monoid::Type&, const Type&, size_t) {
+  }
+};
+
+// без обновлений на отрезке метки в узле нет вовсе
+template <class Value, class Tag, bool = std::is_empty_v<Tag>>
+struct SegmentNode {
+  Value value;
+  Tag tag;
+};
+
+template <class Value, class Tag>
+struct SegmentNode<Value, Tag, true> {
+  Value value;
+  inline static Tag tag{};
+};
+
+// дерево снизу вверх: лист i лежит в tree_[n + i], у узла p дети 2p и 2p + 1.
+// value узла уже учитывает его собственную метку, метки предков — нет; запрос только
+// поднимается от листьев и применяет метки предков к собранному, поэтому он const.
+// Некоммутативные метки перед обновлением проталкиваются вдоль двух граничных путей
+template <class Monoid = MaxMonoid<int>, class Lazy = RangeAdd<int>>
+class SegmentTree {
+ private:
+  using Value = typename Monoid::Type;
+  using Tag = typename Lazy::Type;
+  using Node = SegmentNode<Value, Tag>;
+
+  static const size_t kBatchGrain = 1 << 10;  // запросов на одну задачу пула
+
+  std::vector<Node> tree_;
+  size_t n_ = 1;
+  size_t height_ = 0;
+
+  void Apply(size_t idx, const Tag& tag, size_t length) {
+    Lazy::template Apply<Monoid>(tree_[idx].value, tag, length);
+    if (idx < n_) {
+      tree_[idx].tag = Lazy::Compose(tree_[idx].tag, tag);
+    }
+  }
+
+  void Push(size_t idx, size_t length) {
+    if constexpr (!std::is_empty_v<Tag>) {
+      Apply(2 * idx, tree_[idx].tag, length / 2);
+      Apply(2 * idx + 1, tree_[idx].tag, length / 2);
+      tree_[idx].tag = Lazy::Identity();
+    }
+  }
+
+  void PushPath(size_t leaf) {  // сверху вниз по предкам листа
+    for (size_t shift = height_; shift > 0; --shift) {
+      Push(leaf >> shift, size_t{1} << shift);
+    }
+  }
+
+  void Rebuild(size_t idx) {
+    size_t length = 2;
+    for (idx >>= 1; idx > 0; idx >>= 1, length <<= 1) {
+      tree_[idx].value = Monoid::Combine(tree_[2 * idx].value, tree_[2 * idx + 1].value);
+      Lazy::template Apply<Monoid>(tree_[idx].value, tree_[idx].tag, length);
+    }
+  }
+
+ public:
+  struct Operation {
+    size_t l = 0;
+    size_t r = 0;  // включая r
+    bool is_update = false;
+    Tag tag = Lazy::Identity();
+  };
+
+  explicit SegmentTree(const std::vector<Value> &v) {
+    while (n_ < v.size()) {
+      n_ <<= 1;
+      ++height_;
+    }
+    Node empty{};
+    empty.value = Monoid::Identity();
+    if constexpr (!std::is_empty_v<Tag>) {
+      empty.tag = Lazy::Identity();
+    }
+    tree_.assign(2 * n_, empty);
+    for (size_t i = 0; i < v.size(); ++i) {
+      tree_[n_ + i].value = v[i];
+    }
+    for (size_t i = n_ - 1; i > 0; --i) {
+      tree_[i].value = Monoid::Combine(tree_[2 * i].value, tree_[2 * i + 1].value);
+    }
+  }
+
+  Value Query(size_t l, size_t r) const {  // включая r
+    auto left = Monoid::Identity();
+    auto right = Monoid::Identity();
+    size_t left_length = 0;
+    size_t right_length = 0;
+    // left собран внутри узла l - 1, right — внутри узла r; подъём применяет их метки
+    l += n_;
+    r += n_ + 1;
+    for (size_t length = 1; l < r; length <<= 1) {
+      if (l & 1) {
+        left = Monoid::Combine(left, tree_[l++].value);
+        left_length += length;
+      }
+      if (r & 1) {
+        right = Monoid::Combine(tree_[--r].value, right);
+        right_length += length;
+      }
+      l >>= 1;
+      r >>= 1;
+      if (left_length > 0) {
+        Lazy::template Apply<Monoid>(left, tree_[l - 1].tag, left_length);
+      }
+      if (right_length > 0) {
+        Lazy::template Apply<Monoid>(right, tree_[r].tag, right_length);
+      }
+    }
+    for (--l; l != r;) {
+      l >>= 1;
+      r >>= 1;
+      if (l != r) {
+        if (left_length > 0) {
+          Lazy::template Apply<Monoid>(left, tree_[l].tag, left_length);
+        }
+        if (right_length > 0) {
+          Lazy::template Apply<Monoid>(right, tree_[r].tag, right_length);
+        }
+      }
+    }
+    auto res = Monoid::Combine(left, right);
+    for (; l > 0; l >>= 1) {
+      Lazy::template Apply<Monoid>(res, tree_[l].tag, left_length + right_length);
+    }
+    return res;
+  }
+
+  void Update(size_t l, size_t r, const Tag& tag) {  // включая r
+    static_assert(!std::is_empty_v<Tag>, "Update requires a range update");
+    l += n_;
+    r += n_ + 1;
+    size_t l0 = l;
+    size_t r0 = r - 1;
+    if constexpr (!Lazy::kCommutes) {
+      PushPath(l0);
+      PushPath(r0);
+    }
+    for (size_t length = 1; l < r; l >>= 1, r >>= 1, length <<= 1) {
+      if (l & 1) {
+        Apply(l++, tag, length);
+      }
+      if (r & 1) {
+        Apply(--r, tag, length);
+      }
+    }
+    Rebuild(l0);
+    Rebuild(r0);
+  }
+
+  // результат как при выполнении по очереди: подряд идущие запросы читают неизменное
+  // дерево и делятся между потоками пула, обновления выполняются между ними по порядку.
+  // res[i] — ответ на i-ю операцию, для обновлений Monoid::Identity()
+  std::vector<Value> Batch(const std::vector<Operation>& ops, ThreadPool* pool = nullptr) {
+    std::vector<Value> res(ops.size(), Monoid::Identity());
+    for (size_t begin = 0; begin < ops.size();) {
+      if (ops[begin].is_update) {
+        if constexpr (!std::is_empty_v<Tag>) {
+          Update(ops[begin].l, ops[begin].r, ops[begin].tag);
+        }
+        ++begin;
+        continue;
+      }
+      size_t end = begin;
+      while (end < ops.size() && !ops[end].is_update) {
+        ++end;
+      }
+      auto run = [&](size_t from, size_t to) {
+        for (size_t i = from; i < to; ++i) {
+          res[i] = Query(ops[i].l, ops[i].r);
+        }
+      };
+      if (pool != nullptr) {
+        ParallelFor(*pool, begin, end, kBatchGrain, run);
+      } else {
+        run(begin, end);
+      }
+      begin = end;
+    }
+    return res;
+  }
+
+  void Set(size_t idx, const Value& value) {
+    idx += n_;
+    PushPath(idx);
+    tree_[idx].value = value;
+    Rebuild(idx);
+  }
+};
@@ -0,0 +1,153 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "segment_tree.h"
+
+// дерево отрезков над [0, n) с n до 2^63: узел создаётся только когда его впервые
+// задевает Update, отсутствующий узел означает, что весь его отрезок равен init.
+// Узлы лежат в одном массиве и адресуются 32-битными индексами, 0 — пустой узел.
+// Метки не проталкиваются, поэтому нужны коммутирующие обновления
+template <class Monoid = MaxMonoid<int64_t>, class Lazy = RangeAdd<int64_t>>
+class SparseSegmentTree {
+ private:
+  static_assert(Lazy::kCommutes, "SparseSegmentTree requires commuting range updates");
+
+  using Value = typename Monoid::Type;
+  using Tag = typename Lazy::Type;
+
+  static constexpr uint32_t kNull = 0;
+
+  struct Node : SegmentNode<Value, Tag> {
+    uint32_t left = kNull;
+    uint32_t right = kNull;
+  };
+
+  std::vector<Node> nodes_;
+  uint64_t n_;
+  Value init_;
+
+  Value Repeat(uint64_t length) const {  // отрезок нетронутых позиций
+    if constexpr (Monoid::kScalesWithLength) {
+      return init_ * static_cast<Value>(length);
+    } else {
+      return init_;
+    }
+  }
+
+  Value NodeValue(uint32_t idx, uint64_t length) const {
+    return idx == kNull ? Repeat(length) : nodes_[idx].value;
+  }
+
+  uint32_t Create(uint64_t length) {
+    Node node;
+    node.value = Repeat(length);
+    if constexpr (!std::is_empty_v<Tag>) {
+      node.tag = Lazy::Identity();
+    }
+    nodes_.push_back(node);
+    return static_cast<uint32_t>(nodes_.size() - 1);
+  }
+
+  Value Query(uint32_t idx, uint64_t nl, uint64_t nr, uint64_t l, uint64_t r) const {
+    if (idx == kNull) {
+      return Repeat(std::min(nr, r) - std::max(nl, l));
+    }
+    if (l <= nl && nr <= r) {
+      return nodes_[idx].value;
+    }
+    uint64_t mid = nl + (nr - nl) / 2;
+    auto res = Monoid::Identity();
+    if (l < mid) {
+      res = Query(nodes_[idx].left, nl, mid, l, r);
+    }
+    if (mid < r) {
+      res = Monoid::Combine(res, Query(nodes_[idx].right, mid, nr, l, r));
+    }
+    Lazy::template Apply<Monoid>(res, nodes_[idx].tag, std::min(nr, r) - std::max(nl, l));
+    return res;
+  }
+
+  // nodes_ может переехать при создании узла, поэтому ссылки на узлы не держим
+  void Update(uint32_t idx, uint64_t nl, uint64_t nr, uint64_t l, uint64_t r, const Tag& tag) {
+    if (l <= nl && nr <= r) {
+      Lazy::template Apply<Monoid>(nodes_[idx].value, tag, nr - nl);
+      nodes_[idx].tag = Lazy::Compose(nodes_[idx].tag, tag);
+      return;
+    }
+    uint64_t mid = nl + (nr - nl) / 2;
+    if (l < mid) {
+      if (nodes_[idx].left == kNull) {
+        auto child = Create(mid - nl);
+        nodes_[idx].left = child;
+      }
+      Update(nodes_[idx].left, nl, mid, l, r, tag);
+    }
+    if (mid < r) {
+      if (nodes_[idx].right == kNull) {
+        auto child = Create(nr - mid);
+        nodes_[idx].right = child;
+      }
+      Update(nodes_[idx].right, mid, nr, l, r, tag);
+    }
+    auto value = Monoid::Combine(NodeValue(nodes_[idx].left, mid - nl), NodeValue(nodes_[idx].right, nr - mid));
+    Lazy::template Apply<Monoid>(value, nodes_[idx].tag, nr - nl);
+    nodes_[idx].value = value;
+  }
+
+ public:
+  explicit SparseSegmentTree(uint64_t n, const Value& init = Value{}) : nodes_(1), n_(std::max<uint64_t>(n, 1)), init_(init) {
+    Create(n_);
+  }
+
+  void Reserve(size_t count) {
+    nodes_.reserve(count + 1);
+  }
+
+  size_t NodeCount() const {
+    return nodes_.size() - 1;
+  }
+
+  Value Query(uint64_t l, uint64_t r) const {  // включая r
+    return Query(1, 0, n_, l, r + 1);
+  }
+
+  void Update(uint64_t l, uint64_t r, const Tag& tag) {  // включая r
+    static_assert(!std::is_empty_v<Tag>, "Update requires a range update");
+    Update(1, 0, n_, l, r + 1, tag);
+  }
+};
+
+// сжатие координат для офлайн-запросов: концы отрезков делят ось на элементарные куски,
+// внутри которых все запросы ведут себя одинаково, и дальше хватает плотного SegmentTree
+// на Size() элементах. Кусок заменяется одним элементом, поэтому это подходит только для
+// монойдов без kScalesWithLength (максимум, минимум, gcd)
+template <class Key = int64_t>
+class CoordinateCompressor {
+ private:
+  std::vector<Key> bounds_;  // начала кусков
+
+ public:
+  void AddRange(const Key& l, const Key& r) {  // включая r
+    bounds_.push_back(l);
+    bounds_.push_back(r + 1);
+  }
+
+  void Build() {
+    std::sort(bounds_.begin(), bounds_.end());
+    bounds_.erase(std::unique(bounds_.begin(), bounds_.end()), bounds_.end());
+  }
+
+  size_t Size() const {
+    return bounds_.empty() ? 0 : bounds_.size() - 1;
+  }
+
+  // куски, покрывающие [l, r]; отрезок должен был попасть в AddRange
+  std::pair<size_t, size_t> Range(const Key& l, const Key& r) const {
+    size_t from = std::lower_bound(bounds_.begin(), bounds_.end(), l) - bounds_.begin();
+    size_t to = std::lower_bound(bounds_.begin(), bounds_.end(), r + 1) - bounds_.begin();
+    return {from, to - 1};
+  }
+};
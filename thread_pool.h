@@ -0,0 +1,132 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class ThreadPool {
+ private:
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+
+  void Work() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+ public:
+  explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()) {
+    for (size_t i = 0; i < threads; ++i) {
+      workers_.emplace_back(&ThreadPool::Work, this);
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t Size() const {
+    return workers_.size();
+  }
+
+  void Submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+};
+
+// f отдаётся в пул, g выполняется в текущем потоке; если к моменту ожидания f ещё никто
+// не взял, она выполняется здесь же — поэтому вложенные вызовы не блокируют пул
+template <class F, class G>
+void ParallelInvoke(ThreadPool& pool, F&& f, G&& g) {
+  if (pool.Size() == 0) {
+    f();
+    g();
+    return;
+  }
+  struct State {
+    std::mutex mutex;
+    bool claimed = false;
+    std::promise<void> done;
+  };
+  auto state = std::make_shared<State>();
+  auto claim = [](State& s) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return !std::exchange(s.claimed, true);
+  };
+  auto run = [&f](State& s) {
+    try {
+      f();
+      s.done.set_value();
+    } catch (...) {
+      s.done.set_exception(std::current_exception());
+    }
+  };
+  pool.Submit([state, claim, run] {
+    if (claim(*state)) {
+      run(*state);
+    }
+  });
+  std::exception_ptr g_error;
+  try {
+    g();
+  } catch (...) {
+    g_error = std::current_exception();
+  }
+  if (claim(*state)) {
+    run(*state);
+  }
+  state->done.get_future().get();
+  if (g_error) {
+    std::rethrow_exception(g_error);
+  }
+}
+
+// f(from, to) на отрезках длины не больше grain
+template <class F>
+void ParallelFor(ThreadPool& pool, size_t begin, size_t end, size_t grain, F&& f) {
+  if (end - begin <= std::max<size_t>(grain, 1) || pool.Size() == 0) {
+    if (begin < end) {
+      f(begin, end);
+    }
+    return;
+  }
+  size_t mid = begin + (end - begin) / 2;
+  ParallelInvoke(
+      pool, [&] { ParallelFor(pool, begin, mid, grain, f); }, [&] { ParallelFor(pool, mid, end, grain, f); });
+}
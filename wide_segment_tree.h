@@ -0,0 +1,186 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+// максимум на отрезке с прибавкой на отрезке, как SegmentTree<>, но у узла B детей, лежащих подряд:
+// уровень k — массив, его элемент e отвечает блоку [e * B, e * B + B) уровня k - 1.
+// Значение элемента — максимум блока плюс его собственная метка, метки не проталкиваются.
+// Высота в log2(B) раз меньше, а максимум по блоку считается векторными инструкциями
+template <size_t B = 16>
+class WideSegmentTree {
+ private:
+  static_assert(B >= 8 && (B & (B - 1)) == 0, "B must be a power of two, at least 8");
+
+  static constexpr size_t kLog = __builtin_ctzll(B);
+  static constexpr size_t kMaxHeight = 64;
+  static constexpr int kNeutral = std::numeric_limits<int>::min();
+
+  std::vector<int> values_;  // все уровни подряд, каждый дополнен до кратного B
+  std::vector<int> tags_;    // метки уровней начиная с первого
+  std::vector<size_t> offsets_;
+  size_t height_ = 0;
+
+  static int RangeMax(const int* data, size_t count) {
+    int res = kNeutral;
+    size_t i = 0;
+#if defined(__AVX2__)
+    if (count >= 8) {
+      auto acc = _mm256_set1_epi32(kNeutral);
+      for (; i + 8 <= count; i += 8) {
+        acc = _mm256_max_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+      }
+      auto half = _mm_max_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+      half = _mm_max_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+      half = _mm_max_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+      res = _mm_cvtsi128_si32(half);
+    }
+#elif defined(__SSE4_1__)
+    if (count >= 4) {
+      auto acc = _mm_set1_epi32(kNeutral);
+      for (; i + 4 <= count; i += 4) {
+        acc = _mm_max_epi32(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+      }
+      acc = _mm_max_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+      acc = _mm_max_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+      res = _mm_cvtsi128_si32(acc);
+    }
+#endif
+    for (; i < count; ++i) {
+      res = std::max(res, data[i]);
+    }
+    return res;
+  }
+
+  int* Level(size_t k) {
+    return values_.data() + offsets_[k];
+  }
+
+  const int* Level(size_t k) const {
+    return values_.data() + offsets_[k];
+  }
+
+  int* Tags(size_t k) {  // k >= 1
+    return tags_.data() + offsets_[k] - offsets_[1];
+  }
+
+  const int* Tags(size_t k) const {
+    return tags_.data() + offsets_[k] - offsets_[1];
+  }
+
+  void AddRun(size_t k, size_t from, size_t to, int delta) {
+    auto level = Level(k);
+    for (size_t i = from; i < to; ++i) {
+      level[i] += delta;
+    }
+    if (k > 0) {
+      auto tags = Tags(k);
+      for (size_t i = from; i < to; ++i) {
+        tags[i] += delta;
+      }
+    }
+  }
+
+  void Rebuild(size_t idx) {  // пересчитать предков листа idx
+    for (size_t k = 0; k + 1 < height_; ++k) {
+      idx >>= kLog;
+      Level(k + 1)[idx] = RangeMax(Level(k) + (idx << kLog), B) + Tags(k + 1)[idx];
+    }
+  }
+
+  // сумма меток предков листа idx выше каждого уровня
+  void PathTags(size_t idx, int* above) const {
+    above[height_ - 1] = 0;
+    for (size_t k = height_ - 1; k > 0; --k) {
+      above[k - 1] = above[k] + Tags(k)[idx >> (k * kLog)];
+    }
+  }
+
+ public:
+  explicit WideSegmentTree(const std::vector<int>& v) {
+    size_t count = std::max<size_t>(v.size(), 1);
+    size_t total = 0;
+    while (true) {
+      offsets_.push_back(total);
+      total += (count + B - 1) / B * B;
+      ++height_;
+      if (count == 1) {
+        break;
+      }
+      count = (count + B - 1) / B;
+    }
+    offsets_.push_back(total);
+    values_.assign(total, kNeutral);
+    tags_.assign(total - offsets_[1], 0);
+    std::copy(v.begin(), v.end(), values_.begin());
+    for (size_t k = 1; k < height_; ++k) {
+      size_t entries = (offsets_[k] - offsets_[k - 1]) >> kLog;  // блоки уровня k - 1
+      for (size_t e = 0; e < entries; ++e) {
+        Level(k)[e] = RangeMax(Level(k - 1) + (e << kLog), B);
+      }
+    }
+  }
+
+  // куски, взятые на уровне k, лежат в блоке предка l0 либо r0 на этом уровне;
+  // блок целиком не берётся, а поднимается на уровень выше
+  int Query(size_t l, size_t r) const {  // включая r
+    int above_left[kMaxHeight];
+    int above_right[kMaxHeight];
+    PathTags(l, above_left);
+    PathTags(r, above_right);
+    int res = kNeutral;
+    for (size_t k = 0; l <= r; ++k) {
+      auto level = Level(k);
+      bool head = (l & (B - 1)) != 0;
+      bool tail = ((r + 1) & (B - 1)) != 0;
+      if ((l >> kLog) == (r >> kLog) && (head || tail)) {
+        res = std::max(res, RangeMax(level + l, r - l + 1) + (head ? above_left[k] : above_right[k]));
+        break;
+      }
+      if (head) {
+        res = std::max(res, RangeMax(level + l, B - (l & (B - 1))) + above_left[k]);
+        l = (l >> kLog) + 1;
+      } else {
+        l >>= kLog;
+      }
+      if (tail) {
+        res = std::max(res, RangeMax(level + (r & ~(B - 1)), (r & (B - 1)) + 1) + above_right[k]);
+        r = (r >> kLog) - 1;
+      } else {
+        r >>= kLog;
+      }
+    }
+    return res;
+  }
+
+  void Update(size_t l, size_t r, int delta) {  // включая r
+    size_t l0 = l;
+    size_t r0 = r;
+    for (size_t k = 0; l <= r; ++k) {
+      bool head = (l & (B - 1)) != 0;
+      bool tail = ((r + 1) & (B - 1)) != 0;
+      if ((l >> kLog) == (r >> kLog) && (head || tail)) {
+        AddRun(k, l, r + 1, delta);
+        break;
+      }
+      if (head) {
+        AddRun(k, l, (l | (B - 1)) + 1, delta);
+        l = (l >> kLog) + 1;
+      } else {
+        l >>= kLog;
+      }
+      if (tail) {
+        AddRun(k, r & ~(B - 1), r + 1, delta);
+        r = (r >> kLog) - 1;
+      } else {
+        r >>= kLog;
+      }
+    }
+    Rebuild(l0);
+    Rebuild(r0);
+  }
+};